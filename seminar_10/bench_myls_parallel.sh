@@ -0,0 +1,63 @@
+#!/bin/sh
+# Рекурсивный обход: последовательный recursive_ls() против параллельного
+# (-j). Вывод обоих сравнивается побайтно.
+#
+#   ./bench_myls_parallel.sh [dir] [threads...]
+#
+# Без dir строится синтетическое дерево: FANOUT^DEPTH каталогов по FILES
+# файлов (FANOUT=8 DEPTH=4 FILES=16 по умолчанию). На сетевых и FUSE
+# точках монтирования выигрыш заметнее всего — передайте каталог оттуда.
+
+set -eu
+
+DIR=$(cd "$(dirname "$0")" && pwd)
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+FANOUT=${FANOUT:-8}
+DEPTH=${DEPTH:-4}
+FILES=${FILES:-16}
+
+# color.h не входит в семинар — подставляем минимальный, если его нет.
+if [ ! -f "$DIR/color.h" ]; then
+    printf '%s\n' '#define RESET "\033[0m"' '#define BLUE "\033[1;34m"' \
+        '#define GREEN "\033[1;32m"' '#define RED "\033[1;31m"' > "$TMP/color.h"
+fi
+cc -O2 -pthread -I"$TMP" -o "$TMP/myls" "$DIR/myls.c"
+
+# Тело в подоболочке: у каждого уровня рекурсии свой счётчик i.
+make_tree() (
+    mkdir -p "$1"
+    i=0
+    while [ $i -lt "$FILES" ]; do : > "$1/f$i"; i=$((i + 1)); done
+    [ "$2" -eq 0 ] && return
+    i=0
+    while [ $i -lt "$FANOUT" ]; do make_tree "$1/d$i" $(($2 - 1)); i=$((i + 1)); done
+)
+
+if [ $# -gt 0 ]; then
+    ROOT=$1
+    shift
+else
+    ROOT=$TMP/tree
+    echo "building tree: fanout $FANOUT, depth $DEPTH, $FILES files per directory"
+    make_tree "$ROOT" "$DEPTH"
+fi
+THREADS=${*:-2 4 8 16}
+
+run() {
+    start=$(date +%s.%N)
+    (cd "$ROOT" && "$TMP/myls" -R "$@") > "$TMP/out.$#"
+    end=$(date +%s.%N)
+    awk -v s="$start" -v e="$end" 'BEGIN { printf "%.3f", e - s }'
+}
+
+seq=$(run)
+mv "$TMP/out.0" "$TMP/seq.out"
+printf "%-12s %8s s  (%s lines)\n" "sequential" "$seq" "$(wc -l < "$TMP/seq.out")"
+for t in $THREADS; do
+    par=$(run -j "$t")
+    if cmp -s "$TMP/seq.out" "$TMP/out.2"; then same=identical; else same=DIFFERENT; fi
+    printf "%-12s %8s s  x%s, output %s\n" "-j $t" "$par" \
+        "$(awk -v s="$seq" -v p="$par" 'BEGIN { printf "%.2f", (p > 0 ? s / p : 0) }')" "$same"
+done
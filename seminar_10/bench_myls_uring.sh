@@ -0,0 +1,60 @@
+#!/bin/sh
+# myls -l на медленной файловой системе: statx по одному против пакетного
+# через io_uring (-u). Медленную ФС изображает slowfs — FUSE, который
+# отвечает на каждый LOOKUP и GETATTR через DELAY мкс. Вывод обоих
+# режимов сравнивается побайтно.
+#
+#   sudo ./bench_myls_uring.sh [delay_us...]
+#
+# FILES=2000 DIRS=0 THREADS=32 по умолчанию; DIRS > 0 добавляет -R.
+# Нужен root: slowfs монтирует FUSE сам, без fusermount.
+
+set -eu
+
+DIR=$(cd "$(dirname "$0")" && pwd)
+TMP=$(mktemp -d)
+MNT=$TMP/mnt
+cleanup() {
+    umount "$MNT" 2>/dev/null || umount -l "$MNT" 2>/dev/null || true
+    rm -rf "$TMP"
+}
+trap cleanup EXIT
+
+FILES=${FILES:-2000}
+DIRS=${DIRS:-0}
+THREADS=${THREADS:-32}
+DELAYS=${*:-500 2000}
+
+# color.h не входит в семинар — подставляем минимальный, если его нет.
+if [ ! -f "$DIR/color.h" ]; then
+    printf '%s\n' '#define RESET "\033[0m"' '#define BLUE "\033[1;34m"' \
+        '#define GREEN "\033[1;32m"' '#define RED "\033[1;31m"' > "$TMP/color.h"
+fi
+cc -O2 -pthread -I"$TMP" -o "$TMP/myls" "$DIR/myls.c"
+cc -O2 -pthread -o "$TMP/slowfs" "$DIR/slowfs.c"
+mkdir "$MNT"
+
+OPTS=-l
+[ "$DIRS" -gt 0 ] && OPTS=-lR
+
+run() {
+    start=$(date +%s.%N)
+    (cd "$MNT" && "$TMP/myls" "$@") > "$TMP/out.$#"
+    end=$(date +%s.%N)
+    awk -v s="$start" -v e="$end" 'BEGIN { printf "%.3f", e - s }'
+}
+
+echo "$FILES files per directory, $DIRS subdirectories, $THREADS server threads, myls $OPTS"
+for d in $DELAYS; do
+    "$TMP/slowfs" -n "$FILES" -d "$DIRS" -l "$d" -t "$THREADS" "$MNT" &
+    while ! mountpoint -q "$MNT"; do sleep 0.1; done
+
+    seq=$(run "$OPTS")
+    uring=$(run "$OPTS" -u)
+    if cmp -s "$TMP/out.1" "$TMP/out.2"; then same=identical; else same=DIFFERENT; fi
+    printf "delay %6s us: statx %8s s, io_uring %8s s, x%s, output %s\n" "$d" "$seq" "$uring" \
+        "$(awk -v s="$seq" -v p="$uring" 'BEGIN { printf "%.2f", (p > 0 ? s / p : 0) }')" "$same"
+
+    umount "$MNT"
+    wait
+done
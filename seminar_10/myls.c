@@ -1,20 +1,48 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <sys/sysmacros.h>
+#include <linux/io_uring.h>
 #include "color.h"
 #include <unistd.h>
 #include <string.h>
 #include <pwd.h>
 #include <grp.h>
 #include <time.h>
+#include <pthread.h>
+
+enum sort_key {
+    SORT_NAME,           // по умолчанию
+    SORT_SIZE,           // -S
+    SORT_TIME,           // -t
+    SORT_NONE,           // -U: порядок каталога
+};
 
 struct flags {
     bool recursive_flag;
     bool long_flag;
     bool all_flag;
     bool inode_flag;
+    bool reverse_flag;   // -r
+    bool uring_flag;     // -u: statx пачками через io_uring
+    bool du_flag;        // -s, --du: занятое место по каталогам
+    bool watch_flag;     // -w, --watch: после листинга следить за изменениями
+    const char* cache_path;  // -c, --cache: файл снимка каталогов
+    int  threads;        // -j: потоков обхода для -R, 1 — последовательно
+    enum sort_key sort_key;
+    size_t width;        // ширина строки для колонок, 0 — по имени в строке
 };
 
 void flags_ctor(struct flags* fl) {
@@ -22,6 +50,14 @@ void flags_ctor(struct flags* fl) {
     fl->long_flag = false; 
     fl->all_flag = false; 
     fl->inode_flag = false;
+    fl->reverse_flag = false;
+    fl->uring_flag = false;
+    fl->du_flag = false;
+    fl->watch_flag = false;
+    fl->cache_path = NULL;
+    fl->threads = 1;
+    fl->sort_key = SORT_NAME;
+    fl->width = 0;
 }
 
 static void my_stat(struct dirent* entry, struct stat* file_stat) {
@@ -31,75 +67,365 @@ static void my_stat(struct dirent* entry, struct stat* file_stat) {
     }
 }
 
-static void print_list(struct dirent* entry, struct stat file_stat, bool long_format) {
-    if (!long_format) {
-        if (S_ISDIR(file_stat.st_mode)) {
-            printf(BLUE "%s  " RESET, entry->d_name);
-        } else if (S_ISREG(file_stat.st_mode) && (file_stat.st_mode & 0111)) {
-            printf(GREEN "%s  " RESET, entry->d_name);
-        } else if (S_ISREG(file_stat.st_mode)) {
-            printf("%s  ", entry->d_name);
+// Поля statx, нужные режимам вывода: коротком — только тип и права
+// (цвет и бит исполнения), длинному — ещё владелец, размер и время.
+#define SHORT_STATX_MASK (STATX_TYPE | STATX_MODE)
+#define LONG_STATX_MASK  (STATX_TYPE | STATX_MODE | STATX_NLINK | STATX_UID | \
+                          STATX_GID | STATX_SIZE | STATX_MTIME | STATX_INO)
+// -s: жёсткие ссылки, устройство с inode и занятые блоки.
+#define DU_STATX_MASK    (STATX_TYPE | STATX_MODE | STATX_NLINK | STATX_INO | STATX_BLOCKS)
+
+static void statx_to_stat(const struct statx* stx, struct stat* st) {
+    memset(st, 0, sizeof(*st));
+    st->st_mode  = stx->stx_mode;
+    st->st_nlink = stx->stx_nlink;
+    st->st_uid   = stx->stx_uid;
+    st->st_gid   = stx->stx_gid;
+    st->st_size  = (off_t)stx->stx_size;
+    st->st_ino   = (ino_t)stx->stx_ino;
+    st->st_mtim.tv_sec  = (time_t)stx->stx_mtime.tv_sec;
+    st->st_mtim.tv_nsec = (long)stx->stx_mtime.tv_nsec;
+    st->st_blocks = (blkcnt_t)stx->stx_blocks;
+    st->st_dev   = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+}
+
+// Метаданные записи относительно открытого каталога dfd: без сборки
+// полного пути и без его повторного разбора ядром. Как и stat(),
+// следует по символическим ссылкам, если в at_flags нет
+// AT_SYMLINK_NOFOLLOW.
+static int entry_stat(int dfd, const char* name, unsigned int mask, int at_flags, struct stat* st) {
+    static bool no_statx = false;
+    if (!no_statx) {
+        struct statx stx;
+        if (statx(dfd, name, AT_NO_AUTOMOUNT | at_flags, mask, &stx) == 0) {
+            statx_to_stat(&stx, st);
+            return 0;
+        }
+        if (errno != ENOSYS) return -1;
+        no_statx = true;
+    }
+    return fstatat(dfd, name, st, at_flags);
+}
+
+// Полный stat каждой записи: для -l и сортировки по размеру или времени.
+static bool need_full_stat(const struct flags* fl) {
+    return fl->long_flag || fl->sort_key == SORT_SIZE || fl->sort_key == SORT_TIME;
+}
+
+// Нужен ли stat, или хватит d_type: в коротком режиме цвет зависит только
+// от типа, а для обычных файлов — ещё от бита исполнения. Ссылки
+// разыменовываются, как раньше делал stat(); DT_UNKNOWN — файловая
+// система тип не сообщает.
+static bool need_stat(unsigned char d_type, const struct flags* fl) {
+    if (need_full_stat(fl) || fl->du_flag) return true;
+    return d_type == DT_REG || d_type == DT_LNK || d_type == DT_UNKNOWN;
+}
+
+static void* xmalloc(size_t size) {
+    void* p = malloc(size);
+    if (!p) {
+        perror("malloc");
+        exit(1);
+    }
+    return p;
+}
+
+static void* xrealloc(void* old, size_t size) {
+    void* p = realloc(old, size);
+    if (!p) {
+        perror("realloc");
+        exit(1);
+    }
+    return p;
+}
+
+// ------------------------------- Вывод --------------------------------------
+//
+// Весь вывод идёт через outbuf: у stdout — один буфер на OUT_BUF_SIZE,
+// который сбрасывается write(), у каталогов параллельного обхода —
+// растущий буфер в памяти. Поля -l форматируются вручную, без printf.
+
+#define OUT_BUF_SIZE (1 << 20)
+
+struct outbuf {
+    char*  data;
+    size_t len, cap;
+    int    fd;          // -1 — только память, буфер растёт
+};
+
+static struct outbuf stdout_buf;
+
+static void ob_init(struct outbuf* ob, int fd) {
+    ob->cap  = fd >= 0 ? OUT_BUF_SIZE : 4096;
+    ob->data = xmalloc(ob->cap);
+    ob->len  = 0;
+    ob->fd   = fd;
+}
+
+static void ob_flush(struct outbuf* ob) {
+    size_t done = 0;
+    while (done < ob->len) {
+        ssize_t n = write(ob->fd, ob->data + done, ob->len - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("write");
+            exit(1);
+        }
+        done += (size_t)n;
+    }
+    ob->len = 0;
+}
+
+static void flush_stdout_buf(void) {
+    if (stdout_buf.data) ob_flush(&stdout_buf);
+}
+
+static char* ob_reserve(struct outbuf* ob, size_t n) {
+    if (ob->len + n > ob->cap && ob->fd >= 0) ob_flush(ob);
+    if (ob->len + n > ob->cap) {
+        while (ob->len + n > ob->cap) ob->cap *= 2;
+        ob->data = xrealloc(ob->data, ob->cap);
+    }
+    return ob->data + ob->len;
+}
+
+static void ob_write(struct outbuf* ob, const char* s, size_t n) {
+    memcpy(ob_reserve(ob, n), s, n);
+    ob->len += n;
+}
+
+static void ob_puts(struct outbuf* ob, const char* s) {
+    ob_write(ob, s, strlen(s));
+}
+
+static void ob_putc(struct outbuf* ob, char c) {
+    *ob_reserve(ob, 1) = c;
+    ob->len++;
+}
+
+// Как "%*s": выравнивание вправо, длинная строка не обрезается.
+static void ob_put_padded(struct outbuf* ob, const char* s, size_t len, size_t width) {
+    size_t pad = width > len ? width - len : 0;
+    char* p = ob_reserve(ob, pad + len);
+    memset(p, ' ', pad);
+    memcpy(p + pad, s, len);
+    ob->len += pad + len;
+}
+
+// Как "%*llu".
+static void ob_put_uint(struct outbuf* ob, unsigned long long v, size_t width) {
+    char digits[20];
+    size_t n = 0;
+    do {
+        digits[sizeof(digits) - ++n] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    ob_put_padded(ob, digits + sizeof(digits) - n, n, width);
+}
+
+// uid/gid -> имя: открытая адресация с линейным пробированием. Таблицы
+// свои у каждого потока, поэтому без блокировок; при промахе —
+// getpwuid_r/getgrgid_r, так что NSS спрашивается один раз на id.
+struct id_name {
+    unsigned int id;
+    bool         used;
+    char*        name;
+};
+
+struct id_cache {
+    struct id_name* slots;
+    size_t cap, count;       // cap — степень двойки
+};
+
+static __thread struct id_cache uid_cache, gid_cache;
+
+static size_t id_slot(unsigned int id, size_t cap) {
+    return (size_t)(id * 2654435761u) & (cap - 1);
+}
+
+static char* resolve_id_name(unsigned int id, bool is_group) {
+    size_t buf_len = 1024;
+    char* buf = NULL;
+    char* name = NULL;
+    for (;;) {
+        buf = xrealloc(buf, buf_len);
+        int err;
+        if (is_group) {
+            struct group gr, *res = NULL;
+            err = getgrgid_r((gid_t)id, &gr, buf, buf_len, &res);
+            if (!err && res) name = strdup(res->gr_name);
         } else {
-            printf(RED "%s  " RESET, entry->d_name); 
+            struct passwd pw, *res = NULL;
+            err = getpwuid_r((uid_t)id, &pw, buf, buf_len, &res);
+            if (!err && res) name = strdup(res->pw_name);
+        }
+        if (err != ERANGE) break;
+        buf_len *= 2;
+    }
+    free(buf);
+    return name ? name : strdup("unknown");
+}
+
+static void id_cache_insert(struct id_cache* c, unsigned int id, char* name) {
+    size_t i = id_slot(id, c->cap);
+    while (c->slots[i].used) i = (i + 1) & (c->cap - 1);
+    c->slots[i].id   = id;
+    c->slots[i].used = true;
+    c->slots[i].name = name;
+    c->count++;
+}
+
+static const char* id_cache_name(struct id_cache* c, unsigned int id, bool is_group) {
+    if (c->cap) {
+        for (size_t i = id_slot(id, c->cap); c->slots[i].used; i = (i + 1) & (c->cap - 1)) {
+            if (c->slots[i].id == id) return c->slots[i].name;
         }
-        return;
     }
 
-    char mode[11];
-    strcpy(mode, "----------");
-    if (S_ISDIR(file_stat.st_mode)) mode[0] = 'd';
-    else if (S_ISLNK(file_stat.st_mode)) mode[0] = 'l';
-    else if (S_ISFIFO(file_stat.st_mode)) mode[0] = 'p';
-    else if (S_ISSOCK(file_stat.st_mode)) mode[0] = 's';
-    else if (S_ISCHR(file_stat.st_mode)) mode[0] = 'c';
-    else if (S_ISBLK(file_stat.st_mode)) mode[0] = 'b';
-
-    if (file_stat.st_mode & S_IRUSR) mode[1] = 'r';
-    if (file_stat.st_mode & S_IWUSR) mode[2] = 'w';
-    if (file_stat.st_mode & S_IXUSR) mode[3] = 'x';
-    if (file_stat.st_mode & S_IRGRP) mode[4] = 'r';
-    if (file_stat.st_mode & S_IWGRP) mode[5] = 'w';
-    if (file_stat.st_mode & S_IXGRP) mode[6] = 'x';
-    if (file_stat.st_mode & S_IROTH) mode[7] = 'r';
-    if (file_stat.st_mode & S_IWOTH) mode[8] = 'w';
-    if (file_stat.st_mode & S_IXOTH) mode[9] = 'x';
-
-    struct passwd *pw = getpwuid(file_stat.st_uid);
-    struct group  *gr = getgrgid(file_stat.st_gid);
-    const char *owner = pw ? pw->pw_name : "unknown";
-    const char *group = gr ? gr->gr_name : "unknown";
-
-    long long size = (long long)file_stat.st_size;
-
-    char time_buf[20];
-    struct tm *tm = localtime(&file_stat.st_mtime);
-    if (tm) {
-        strftime(time_buf, sizeof(time_buf), "%b %d %H:%M", tm);
-    } else {
-        strcpy(time_buf, "??? ?? ??:??");
+    // Заполнение не больше половины — короткие цепочки пробирования.
+    if ((c->count + 1) * 2 > c->cap) {
+        struct id_cache grown = {0};
+        grown.cap   = c->cap ? c->cap * 2 : 16;
+        grown.slots = xmalloc(grown.cap * sizeof(*grown.slots));
+        memset(grown.slots, 0, grown.cap * sizeof(*grown.slots));
+        for (size_t i = 0; i < c->cap; i++) {
+            if (c->slots[i].used) id_cache_insert(&grown, c->slots[i].id, c->slots[i].name);
+        }
+        free(c->slots);
+        *c = grown;
+    }
+
+    char* name = resolve_id_name(id, is_group);
+    id_cache_insert(c, id, name);
+    return name;
+}
+
+static void id_cache_release(struct id_cache* c) {
+    for (size_t i = 0; i < c->cap; i++) {
+        if (c->slots[i].used) free(c->slots[i].name);
     }
+    free(c->slots);
+    memset(c, 0, sizeof(*c));
+}
+
+// mtime -> "%b %d %H:%M": строка меняется раз в минуту (смещения часовых
+// поясов кратны минуте), поэтому она запоминается по номеру минуты в
+// таблице прямого отображения. localtime_r — только при промахе.
+#define TIME_MEMO_SLOTS 256
+
+struct time_memo {
+    long long minute;
+    bool      valid;
+    size_t    len;
+    char      text[20];
+};
+
+static __thread struct time_memo time_memo[TIME_MEMO_SLOTS];
 
-    printf("%s %3ld %8s %8s %8lld %s ", 
-           mode,
-           (long)file_stat.st_nlink,
-           owner,
-           group,
-           size,
-           time_buf);
+static const struct time_memo* format_mtime(time_t mtime) {
+    long long t = (long long)mtime;
+    long long minute = t >= 0 ? t / 60 : -((-t + 59) / 60);
+    struct time_memo* m = &time_memo[(unsigned long long)minute % TIME_MEMO_SLOTS];
+    if (m->valid && m->minute == minute) return m;
 
-    if (S_ISDIR(file_stat.st_mode)) {
-        printf(BLUE "%s" RESET, entry->d_name);
-    } else if (S_ISREG(file_stat.st_mode) && (file_stat.st_mode & 0111)) {
-        printf(GREEN "%s" RESET, entry->d_name);
+    struct tm tm;
+    if (localtime_r(&mtime, &tm)) {
+        m->len = strftime(m->text, sizeof(m->text), "%b %d %H:%M", &tm);
     } else {
-        printf("%s", entry->d_name);
+        m->len = 0;
     }
-    putchar('\n');
+    if (m->len == 0) {
+        strcpy(m->text, "??? ?? ??:??");
+        m->len = strlen(m->text);
+    }
+    m->minute = minute;
+    m->valid  = true;
+    return m;
+}
+
+static const char* name_color(mode_t mode, bool long_format) {
+    if (S_ISDIR(mode))                   return BLUE;
+    if (S_ISREG(mode) && (mode & 0111)) return GREEN;
+    if (S_ISREG(mode) || long_format)   return NULL;
+    return RED;
+}
+
+static void print_header(struct outbuf* out, const char* path, int depth) {
+    if (depth == 0) ob_putc(out, '\n');
+    ob_puts(out, path);
+    ob_write(out, ":\n", 2);
+}
+
+// Ширины колонок -l, общие для всего каталога.
+struct long_widths {
+    size_t nlink, owner, group, size;
+};
+
+static void print_long_entry(struct outbuf* out, const char* name, const struct stat* st,
+                             const struct long_widths* w) {
+    const char* color = name_color(st->st_mode, true);
+    char mode[11];
+    strcpy(mode, "----------");
+    if (S_ISDIR(st->st_mode)) mode[0] = 'd';
+    else if (S_ISLNK(st->st_mode)) mode[0] = 'l';
+    else if (S_ISFIFO(st->st_mode)) mode[0] = 'p';
+    else if (S_ISSOCK(st->st_mode)) mode[0] = 's';
+    else if (S_ISCHR(st->st_mode)) mode[0] = 'c';
+    else if (S_ISBLK(st->st_mode)) mode[0] = 'b';
+
+    if (st->st_mode & S_IRUSR) mode[1] = 'r';
+    if (st->st_mode & S_IWUSR) mode[2] = 'w';
+    if (st->st_mode & S_IXUSR) mode[3] = 'x';
+    if (st->st_mode & S_IRGRP) mode[4] = 'r';
+    if (st->st_mode & S_IWGRP) mode[5] = 'w';
+    if (st->st_mode & S_IXGRP) mode[6] = 'x';
+    if (st->st_mode & S_IROTH) mode[7] = 'r';
+    if (st->st_mode & S_IWOTH) mode[8] = 'w';
+    if (st->st_mode & S_IXOTH) mode[9] = 'x';
+
+    const char* owner = id_cache_name(&uid_cache, st->st_uid, false);
+    const char* group = id_cache_name(&gid_cache, st->st_gid, true);
+    const struct time_memo* when = format_mtime(st->st_mtime);
+
+    // "%s %*ld %*s %*s %*lld %s "
+    ob_write(out, mode, 10);
+    ob_putc(out, ' ');
+    ob_put_uint(out, (unsigned long long)st->st_nlink, w->nlink);
+    ob_putc(out, ' ');
+    ob_put_padded(out, owner, strlen(owner), w->owner);
+    ob_putc(out, ' ');
+    ob_put_padded(out, group, strlen(group), w->group);
+    ob_putc(out, ' ');
+    ob_put_uint(out, (unsigned long long)st->st_size, w->size);
+    ob_putc(out, ' ');
+    ob_write(out, when->text, when->len);
+    ob_putc(out, ' ');
+
+    if (color) ob_puts(out, color);
+    ob_puts(out, name);
+    if (color) ob_puts(out, RESET);
+    ob_putc(out, '\n');
+}
+
+// Как у ls: ширина терминала, иначе $COLUMNS, иначе 80.
+static size_t terminal_width(void) {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) return ws.ws_col;
+    const char* env = getenv("COLUMNS");
+    if (env && atoi(env) > 0) return (size_t)atoi(env);
+    return 80;
 }
 
 static void get_options(struct flags* fl, int argc, char* argv[]) {
     int opt;
-    while ((opt = getopt(argc, argv, "Ralh")) != -1) {
+    static const struct option long_opts[] = {
+        {"du", no_argument, NULL, 's'},
+        {"cache", required_argument, NULL, 'c'},
+        {"watch", no_argument, NULL, 'w'},
+        {NULL, 0, NULL, 0},
+    };
+    bool columns = isatty(STDOUT_FILENO);
+    while ((opt = getopt_long(argc, argv, "Ralhj:StrU1Cusc:w", long_opts, NULL)) != -1) {
         switch (opt) {
             case 'R': {
                 fl->recursive_flag = true;
@@ -117,86 +443,2098 @@ static void get_options(struct flags* fl, int argc, char* argv[]) {
                 fl->inode_flag = true; 
                 break;
             }
+            case 'j': {
+                fl->threads = atoi(optarg);
+                if (fl->threads < 1) fl->threads = 1;
+                break;
+            }
+            case 'S': {
+                fl->sort_key = SORT_SIZE;
+                break;
+            }
+            case 't': {
+                fl->sort_key = SORT_TIME;
+                break;
+            }
+            case 'U': {
+                fl->sort_key = SORT_NONE;
+                break;
+            }
+            case 'r': {
+                fl->reverse_flag = true;
+                break;
+            }
+            case 'c': {
+                fl->cache_path = optarg;
+                break;
+            }
+            case 's': {
+                fl->du_flag = true;
+                break;
+            }
+            case 'w': {
+                fl->watch_flag = true;
+                break;
+            }
+            case 'u': {
+                fl->uring_flag = true;
+                break;
+            }
+            case '1': {
+                columns = false;
+                break;
+            }
+            case 'C': {
+                columns = true;
+                break;
+            }
             default:
                 perror("error in get_options");
                 exit(1);
         }
     }
+    if (columns) fl->width = terminal_width();
 }
 
-static void open_dir_and_print_list(const char* const path, char subdirs[][256], size_t* subdir_count, const struct flags* fl) {
-    DIR* directory = opendir(path);
-    if (!directory) {
-        perror("unable to open directory");
-        exit(1);
+// Имена подкаталогов одного каталога: подряд в одном буфере, плюс массив
+// смещений. Оба растут удвоением, так что память пропорциональна числу и
+// длине настоящих имён — без лимитов на количество и длину.
+struct name_arena {
+    char*   data;
+    size_t  len, cap;
+    size_t* offs;
+    size_t  count, offs_cap;
+};
+
+static void arena_push(struct name_arena* a, const char* name, size_t name_len) {
+    if (a->len + name_len + 1 > a->cap) {
+        a->cap  = (a->len + name_len + 1) * 2;
+        a->data = xrealloc(a->data, a->cap);
+    }
+    if (a->count == a->offs_cap) {
+        a->offs_cap = a->offs_cap ? a->offs_cap * 2 : 64;
+        a->offs     = xrealloc(a->offs, a->offs_cap * sizeof(*a->offs));
+    }
+    memcpy(a->data + a->len, name, name_len + 1);
+    a->offs[a->count++] = a->len;
+    a->len += name_len + 1;
+}
+
+static const char* arena_name(const struct name_arena* a, size_t i) {
+    return a->data + a->offs[i];
+}
+
+static void arena_clear(struct name_arena* a) {
+    a->len   = 0;
+    a->count = 0;
+}
+
+static void arena_release(struct name_arena* a) {
+    free(a->data);
+    free(a->offs);
+    memset(a, 0, sizeof(*a));
+}
+
+// Каталог читается через getdents64 большими порциями: число системных
+// вызовов — размер каталога / DENTS_BUF_SIZE, а не по одному на 32 КиБ,
+// как у readdir(). Буфер один на поток обхода.
+#define DENTS_BUF_SIZE (1 << 20)
+
+struct linux_dirent64 {
+    ino64_t        d_ino;
+    off64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+};
+
+// ------------------------ Пакетный statx через io_uring (-u) -----------------
+//
+// На FUSE и сетевых файловых системах каждый stat — поход к серверу, и
+// последовательные вызовы складывают задержки. С -u каталог сначала
+// читается целиком, затем statx всех его записей отправляются через
+// io_uring очередью глубиной до URING_DEPTH, и ответы разбираются по мере
+// прихода. Порядок вывода от этого не зависит: результат пишется в запись
+// по индексу, сортировка — после. Кольцо своё у каждого потока обхода;
+// liburing не нужна — только системные вызовы и mmap колец.
+
+#define URING_DEPTH 256
+
+struct uring {
+    int fd;                          // -1 — io_uring недоступен, statx по одному
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+    void*  sq_ring;
+    void*  cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+
+    struct statx stx[URING_DEPTH];   // буфер ответа на каждое место очереди
+    uint32_t entry[URING_DEPTH];     // место очереди -> индекс записи
+    uint32_t free_slots[URING_DEPTH];
+    unsigned free_count;
+};
+
+static bool uring_supports_statx(int fd) {
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = xmalloc(size);
+    memset(probe, 0, size);
+    bool ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+              probe->last_op >= IORING_OP_STATX &&
+              (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return ok;
+}
+
+// false — io_uring нет (старое ядро, seccomp, запрет sysctl) или он не
+// умеет statx; тогда остаётся обычный путь.
+static bool uring_init(struct uring* r) {
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = (int)syscall(__NR_io_uring_setup, URING_DEPTH, &p);
+    if (fd < 0) return false;
+    if (!uring_supports_statx(fd)) {
+        close(fd);
+        return false;
     }
 
-    if (subdir_count) {
-        *subdir_count = 0;
+    r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_ring_size > r->sq_ring_size) r->sq_ring_size = r->cq_ring_size;
+        r->cq_ring_size = r->sq_ring_size;
+    }
+    r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQ_RING);
+    if (r->sq_ring == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ring = r->sq_ring;
+    } else {
+        r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          fd, IORING_OFF_CQ_RING);
+        if (r->cq_ring == MAP_FAILED) {
+            munmap(r->sq_ring, r->sq_ring_size);
+            close(fd);
+            return false;
+        }
+    }
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        if (r->cq_ring != r->sq_ring) munmap(r->cq_ring, r->cq_ring_size);
+        munmap(r->sq_ring, r->sq_ring_size);
+        close(fd);
+        return false;
     }
 
-    struct dirent *entry;
-    struct stat file_stat;
+    char* sq = r->sq_ring;
+    char* cq = r->cq_ring;
+    r->sq_head  = (unsigned*)(sq + p.sq_off.head);
+    r->sq_tail  = (unsigned*)(sq + p.sq_off.tail);
+    r->sq_mask  = (unsigned*)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned*)(sq + p.sq_off.array);
+    r->cq_head  = (unsigned*)(cq + p.cq_off.head);
+    r->cq_tail  = (unsigned*)(cq + p.cq_off.tail);
+    r->cq_mask  = (unsigned*)(cq + p.cq_off.ring_mask);
+    r->cqes     = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
 
-    while ((entry = readdir(directory))) {
-        if (!fl->all_flag && entry->d_name[0] == '.') continue;
+    // statx выполняют рабочие потоки io-wq, а их по умолчанию не больше
+    // 4 на процессор — мало, когда каждый ждёт сеть. Старые ядра этого не
+    // умеют; тогда остаётся предел по умолчанию.
+    unsigned max_workers[2] = {URING_DEPTH, URING_DEPTH};
+    syscall(__NR_io_uring_register, fd, IORING_REGISTER_IOWQ_MAX_WORKERS, max_workers, 2);
 
-        char full_path[4096];
-        snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
+    for (unsigned i = 0; i < URING_DEPTH; i++) r->free_slots[i] = URING_DEPTH - 1 - i;
+    r->free_count = URING_DEPTH;
+    r->fd = fd;
+    return true;
+}
 
-        if (stat(full_path, &file_stat) != 0) {
-            continue;
+static void uring_release(struct uring* r) {
+    if (r->fd < 0) return;
+    munmap(r->sqes, r->sqes_size);
+    if (r->cq_ring != r->sq_ring) munmap(r->cq_ring, r->cq_ring_size);
+    munmap(r->sq_ring, r->sq_ring_size);
+    close(r->fd);
+    r->fd = -1;
+}
+
+static void uring_queue_statx(struct uring* r, int dfd, const char* name, unsigned int mask, int at_flags,
+                              uint32_t idx) {
+    unsigned slot = r->free_slots[--r->free_count];
+    r->entry[slot] = idx;
+
+    unsigned tail = *r->sq_tail;
+    unsigned pos  = tail & *r->sq_mask;
+    struct io_uring_sqe* sqe = &r->sqes[pos];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode      = IORING_OP_STATX;
+    sqe->fd          = dfd;
+    sqe->addr        = (uint64_t)(uintptr_t)name;
+    sqe->len         = mask;
+    sqe->off         = (uint64_t)(uintptr_t)&r->stx[slot];
+    sqe->statx_flags = AT_NO_AUTOMOUNT | at_flags;
+    sqe->user_data   = slot;
+    r->sq_array[pos] = pos;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// Отправить всё, что лежит в очереди, и дождаться хотя бы одного ответа.
+static void uring_submit_and_wait(struct uring* r) {
+    for (;;) {
+        unsigned to_submit = *r->sq_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+        long ret = syscall(__NR_io_uring_enter, r->fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret >= 0) return;
+        if (errno != EINTR) {
+            perror("io_uring_enter");
+            exit(1);
+        }
+    }
+}
+
+// --------------------- Записи каталога и сортировка ------------------------
+//
+// Записи каталога копятся до вывода, чтобы их отсортировать и разложить
+// по колонкам. Хранятся по полям: имена подряд в name_arena, режим,
+// размер, время и прочее — в плотных массивах. Массивы принадлежат
+// dir_reader потока и переиспользуются от каталога к каталогу, так что
+// malloc на каждую запись нет.
+
+// Файл, который может встретиться в дереве не раз (жёсткие ссылки).
+struct du_id {
+    dev_t dev;
+    ino_t ino;
+};
+
+struct dir_entries {
+    struct name_arena names;
+    mode_t*  modes;
+    off_t*   sizes;
+    time_t*  mtimes;
+    uint32_t* mtime_nsecs; // для -t: ls сравнивает время с наносекундами
+    nlink_t* nlinks;
+    uid_t*   uids;
+    gid_t*   gids;
+    uint64_t* du_blocks;   // -s: вклад записи в итог каталога
+    struct du_id* du_ids;  // -s: inode файла с несколькими ссылками, ino 0 — нет
+    size_t   cap;
+};
+
+// Ссылка на запись при сортировке: указатель прямо на имя (без похода в
+// массив смещений), числовой ключ для -S/-t и ширина имени на экране.
+struct sort_ref {
+    const char* name;
+    uint64_t    key;
+    uint32_t    idx;
+    uint32_t    width;
+};
+
+// Всё, что поток обхода переиспользует между каталогами.
+struct dir_reader {
+    char* dents;                 // DENTS_BUF_SIZE байт для getdents64
+    struct dir_entries ents;
+    struct sort_ref* refs;       // порядок вывода, count записей
+    struct sort_ref* tmp;        // второй буфер поразрядной сортировки
+    size_t count, refs_cap;
+    uint32_t* pending;           // записи, ждущие statx через кольцо
+    size_t pending_count, pending_cap;
+    struct uring ring;
+};
+
+static void reader_init(struct dir_reader* rd, const struct flags* fl) {
+    memset(rd, 0, sizeof(*rd));
+    rd->dents = xmalloc(DENTS_BUF_SIZE);
+    rd->ring.fd = -1;
+    if (fl->uring_flag) uring_init(&rd->ring);
+}
+
+static void reader_release(struct dir_reader* rd) {
+    struct dir_entries* e = &rd->ents;
+    arena_release(&e->names);
+    free(e->modes);
+    free(e->sizes);
+    free(e->mtimes);
+    free(e->mtime_nsecs);
+    free(e->nlinks);
+    free(e->uids);
+    free(e->gids);
+    free(e->du_blocks);
+    free(e->du_ids);
+    free(rd->refs);
+    free(rd->tmp);
+    free(rd->pending);
+    uring_release(&rd->ring);
+    free(rd->dents);
+    memset(rd, 0, sizeof(*rd));
+}
+
+static void entries_set(struct dir_entries* e, size_t i, const struct stat* st);
+
+static void entries_push(struct dir_entries* e, const char* name, size_t name_len, const struct stat* st) {
+    size_t i = e->names.count;
+    if (i == e->cap) {
+        e->cap    = e->cap ? e->cap * 2 : 256;
+        e->modes  = xrealloc(e->modes,  e->cap * sizeof(*e->modes));
+        e->sizes  = xrealloc(e->sizes,  e->cap * sizeof(*e->sizes));
+        e->mtimes = xrealloc(e->mtimes, e->cap * sizeof(*e->mtimes));
+        e->mtime_nsecs = xrealloc(e->mtime_nsecs, e->cap * sizeof(*e->mtime_nsecs));
+        e->nlinks = xrealloc(e->nlinks, e->cap * sizeof(*e->nlinks));
+        e->uids   = xrealloc(e->uids,   e->cap * sizeof(*e->uids));
+        e->gids   = xrealloc(e->gids,   e->cap * sizeof(*e->gids));
+        e->du_blocks = xrealloc(e->du_blocks, e->cap * sizeof(*e->du_blocks));
+        e->du_ids    = xrealloc(e->du_ids,    e->cap * sizeof(*e->du_ids));
+    }
+    arena_push(&e->names, name, name_len);
+    entries_set(e, i, st);
+    e->du_blocks[i]  = 0;
+    e->du_ids[i].ino = 0;
+}
+
+static void entries_set(struct dir_entries* e, size_t i, const struct stat* st) {
+    e->modes[i]  = st->st_mode;
+    e->sizes[i]  = st->st_size;
+    e->mtimes[i] = st->st_mtim.tv_sec;
+    e->mtime_nsecs[i] = (uint32_t)st->st_mtim.tv_nsec;
+    e->nlinks[i] = st->st_nlink;
+    e->uids[i]   = st->st_uid;
+    e->gids[i]   = st->st_gid;
+}
+
+static void entry_stat_at(const struct dir_entries* e, size_t i, struct stat* st) {
+    memset(st, 0, sizeof(*st));
+    st->st_mode  = e->modes[i];
+    st->st_size  = e->sizes[i];
+    st->st_mtim.tv_sec  = e->mtimes[i];
+    st->st_mtim.tv_nsec = e->mtime_nsecs[i];
+    st->st_nlink = e->nlinks[i];
+    st->st_uid   = e->uids[i];
+    st->st_gid   = e->gids[i];
+}
+
+// Ширина имени на экране: в UTF-8 — число байтов, не являющихся
+// продолжением символа.
+static uint32_t name_width(const char* name) {
+    uint32_t w = 0;
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+        if ((*p & 0xC0) != 0x80) w++;
+    }
+    return w;
+}
+
+static void swap_refs(struct sort_ref* a, struct sort_ref* b) {
+    struct sort_ref t = *a;
+    *a = *b;
+    *b = t;
+}
+
+static int ref_char(const struct sort_ref* r, size_t depth) {
+    return (unsigned char)r->name[depth];
+}
+
+static void insertion_sort_refs(struct sort_ref* a, size_t n, size_t depth) {
+    for (size_t i = 1; i < n; i++) {
+        for (size_t j = i; j > 0 && strcmp(a[j].name + depth, a[j - 1].name + depth) < 0; j--) {
+            swap_refs(&a[j], &a[j - 1]);
+        }
+    }
+}
+
+// Многоключевая быстрая сортировка (Bentley, Sedgewick): разбиение на три
+// части по одному символу, средняя часть дальше сортируется со следующего
+// символа — общий префикс не сравнивается заново. Порядок байтовый, как
+// у strcmp() (ls в локали C).
+static void mkqsort_refs(struct sort_ref* a, size_t n, size_t depth) {
+    while (n > 1) {
+        if (n < 16) {
+            insertion_sort_refs(a, n, depth);
+            return;
+        }
+
+        size_t m = n / 2;
+        int x = ref_char(&a[0], depth), y = ref_char(&a[m], depth), z = ref_char(&a[n - 1], depth);
+        int v = (x < y) ? (y < z ? y : (x < z ? z : x))
+                        : (x < z ? x : (y < z ? z : y));
+
+        size_t lt = 0, i = 0, gt = n;
+        while (i < gt) {
+            int c = ref_char(&a[i], depth);
+            if (c < v)      swap_refs(&a[lt++], &a[i++]);
+            else if (c > v) swap_refs(&a[i], &a[--gt]);
+            else            i++;
+        }
+
+        mkqsort_refs(a, lt, depth);
+        mkqsort_refs(a + gt, n - gt, depth);
+        if (v == 0) return;        // строки средней части кончились — равны
+        a += lt;
+        n  = gt - lt;
+        depth++;
+    }
+}
+
+// Поразрядная LSD-сортировка по key, по байту за проход. Устойчива,
+// поэтому после сортировки по имени равные ключи остаются по имени.
+// Проходы, где байт у всех одинаков, пропускаются.
+static void radix_sort_refs(struct sort_ref* a, struct sort_ref* tmp, size_t n) {
+    struct sort_ref* src = a;
+    struct sort_ref* dst = tmp;
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t count[256] = {0};
+        for (size_t i = 0; i < n; i++) count[(src[i].key >> shift) & 0xFF]++;
+        if (count[(src[0].key >> shift) & 0xFF] == n) continue;
+
+        size_t pos = 0;
+        for (int b = 0; b < 256; b++) {
+            size_t c = count[b];
+            count[b] = pos;
+            pos += c;
+        }
+        for (size_t i = 0; i < n; i++) dst[count[(src[i].key >> shift) & 0xFF]++] = src[i];
+
+        struct sort_ref* t = src;
+        src = dst;
+        dst = t;
+    }
+    if (src != a) memcpy(a, src, n * sizeof(*a));
+}
+
+// Порядок вывода — в rd->refs. -S и -t: по убыванию, при равенстве — по
+// имени; -U — порядок каталога. Записи с режимом 0 (statx не удался)
+// пропускаются.
+static void sort_entries(struct dir_reader* rd, const struct flags* fl) {
+    const struct dir_entries* e = &rd->ents;
+    size_t total = e->names.count;
+    if (total > rd->refs_cap) {
+        rd->refs_cap = total * 2;
+        rd->refs = xrealloc(rd->refs, rd->refs_cap * sizeof(*rd->refs));
+        rd->tmp  = xrealloc(rd->tmp,  rd->refs_cap * sizeof(*rd->tmp));
+    }
+
+    struct sort_ref* refs = rd->refs;
+    size_t n = 0;
+    for (size_t i = 0; i < total; i++) {
+        if (e->modes[i] == 0) continue;
+        struct sort_ref* r = &refs[n++];
+        r->name  = arena_name(&e->names, i);
+        r->idx   = (uint32_t)i;
+        r->width = fl->long_flag ? 0 : name_width(r->name);
+        switch (fl->sort_key) {
+            case SORT_SIZE: r->key = ~(uint64_t)e->sizes[i]; break;
+            // Секунды << 30 | наносекунды: влезает при |секунды| < 2^33.
+            case SORT_TIME: r->key = ~(((uint64_t)e->mtimes[i] << 30 | e->mtime_nsecs[i]) ^ (1ull << 63)); break;
+            default:        r->key = 0;
         }
+    }
+    rd->count = n;
+    if (fl->sort_key == SORT_NONE || n < 2) return;
+
+    mkqsort_refs(refs, n, 0);
+    if (fl->sort_key != SORT_NAME) radix_sort_refs(refs, rd->tmp, n);
+
+    if (fl->reverse_flag) {
+        for (size_t i = 0, j = n - 1; i < j; i++, j--) swap_refs(&refs[i], &refs[j]);
+    }
+}
 
-        print_list(entry, file_stat, fl->long_flag);
+static size_t count_digits(unsigned long long v) {
+    size_t n = 1;
+    while (v >= 10) {
+        v /= 10;
+        n++;
+    }
+    return n;
+}
+
+static void print_long_list(struct outbuf* out, struct dir_reader* rd, size_t n) {
+    const struct dir_entries* e = &rd->ents;
+    struct long_widths w = {3, 8, 8, 8};
+    for (size_t i = 0; i < n; i++) {
+        size_t k = rd->refs[i].idx;
+        size_t len;
+        if ((len = count_digits(e->nlinks[k])) > w.nlink) w.nlink = len;
+        if ((len = strlen(id_cache_name(&uid_cache, e->uids[k], false))) > w.owner) w.owner = len;
+        if ((len = strlen(id_cache_name(&gid_cache, e->gids[k], true))) > w.group) w.group = len;
+        if ((len = count_digits((unsigned long long)e->sizes[k])) > w.size) w.size = len;
+    }
+
+    struct stat st;
+    for (size_t i = 0; i < n; i++) {
+        entry_stat_at(e, rd->refs[i].idx, &st);
+        print_long_entry(out, rd->refs[i].name, &st, &w);
+    }
+}
+
+static void print_short_name(struct outbuf* out, const struct sort_ref* r, const struct dir_entries* e) {
+    const char* color = name_color(e->modes[r->idx], false);
+    if (color) ob_puts(out, color);
+    ob_puts(out, r->name);
+    if (color) ob_puts(out, RESET);
+}
+
+#define MIN_COLUMN_WIDTH 3       // имя в один символ и два пробела
+
+// Раскладка как у ls -C: имена идут сверху вниз, затем слева направо;
+// берётся наибольшее число колонок, при котором строка влезает в
+// width. Все варианты числа колонок считаются за один проход по записям.
+static void print_columns(struct outbuf* out, struct dir_reader* rd, size_t n, size_t width) {
+    const struct sort_ref* refs = rd->refs;
+    size_t max_cols = width / MIN_COLUMN_WIDTH;
+    if (max_cols > n) max_cols = n;
+    if (max_cols == 0) max_cols = 1;
+
+    // Вариант c колонок: ширины колонок с col_w[c * (c - 1) / 2].
+    size_t* col_w    = xmalloc(max_cols * (max_cols + 1) / 2 * sizeof(*col_w));
+    size_t* line_len = xmalloc((max_cols + 1) * sizeof(*line_len));
+    bool*   fits     = xmalloc((max_cols + 1) * sizeof(*fits));
+    memset(col_w, 0, max_cols * (max_cols + 1) / 2 * sizeof(*col_w));
+    for (size_t c = 1; c <= max_cols; c++) {
+        line_len[c] = 0;
+        fits[c]     = true;
+    }
 
-        if (subdirs && subdir_count && S_ISDIR(file_stat.st_mode)) {
-            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
-            if (*subdir_count < 1024) {
-                strncpy(subdirs[*subdir_count], entry->d_name, 255);
-                subdirs[*subdir_count][255] = '\0';
-                (*subdir_count)++;
+    for (size_t i = 0; i < n; i++) {
+        for (size_t c = 1; c <= max_cols; c++) {
+            if (!fits[c]) continue;
+            size_t rows = (n + c - 1) / c;
+            size_t col  = i / rows;
+            size_t w    = refs[i].width + (col + 1 < c ? 2 : 0);
+            size_t* cw  = &col_w[c * (c - 1) / 2 + col];
+            if (w > *cw) {
+                line_len[c] += w - *cw;
+                *cw = w;
+                if (line_len[c] > width) fits[c] = false;
             }
+        }
+    }
+
+    size_t cols = max_cols;
+    while (cols > 1 && !fits[cols]) cols--;
+    const size_t* cw = &col_w[cols * (cols - 1) / 2];
+    size_t rows = (n + cols - 1) / cols;
+
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t c = 0; c < cols; c++) {
+            size_t i = c * rows + r;
+            if (i >= n) break;
+            print_short_name(out, &refs[i], &rd->ents);
+            if (i + rows < n) {
+                size_t pad = cw[c] - refs[i].width;
+                memset(ob_reserve(out, pad), ' ', pad);
+                out->len += pad;
             }
         }
+        ob_putc(out, '\n');
     }
-    putchar('\n');
-    closedir(directory);
+
+    free(fits);
+    free(line_len);
+    free(col_w);
 }
 
-static void recursive_ls(const char* path, int depth, const struct flags* fl) {
-    char subdirs[1024][256]; 
-    size_t subdir_count = 0;
+static void print_list(struct outbuf* out, struct dir_reader* rd, const struct flags* fl) {
+    size_t n = rd->count;
+    if (fl->long_flag) {
+        print_long_list(out, rd, n);
+        ob_putc(out, '\n');
+    } else if (n == 0) {
+        ob_putc(out, '\n');
+    } else if (fl->width == 0) {
+        for (size_t i = 0; i < n; i++) {
+            print_short_name(out, &rd->refs[i], &rd->ents);
+            ob_putc(out, '\n');
+        }
+    } else {
+        print_columns(out, rd, n, fl->width);
+    }
+}
 
-    open_dir_and_print_list(path, subdirs, &subdir_count, fl);
+// ------------------------ Занятое место (-s, --du) --------------------------
+//
+// Блоки (st_blocks) считаются в том же обходе, что и листинг. Файл
+// учитывается в своём каталоге, сам каталог — при чтении его же (fstat
+// открытого дескриптора). Итог каталога — его блоки плюс итоги
+// подкаталогов; строки "КиБ<TAB>путь" идут снизу вверх, как у du, после
+// листинга. Считается то же дерево, что показано: без -a скрытые записи
+// не входят.
+//
+// Файлы с несколькими жёсткими ссылками и каталоги считаются один раз —
+// там, где встретились первыми в порядке du: сам каталог, затем его
+// записи по порядку вывода, а на подкаталоге — сначала всё его
+// поддерево. Поэтому при чтении такие записи только заявляются
+// (struct du_dir), а засчитывает их du_settle() — в recursive_ls() и в
+// упорядоченном выводе параллельного обхода, в одном потоке. Итоги
+// каталогов не зависят от -j и совпадают с du -a, если du обходит
+// каталоги в том же порядке.
 
-    for (size_t i = 0; i < subdir_count; i++) {
-        char full_path[4096];
-        snprintf(full_path, sizeof(full_path), "%s/%s", path, subdirs[i]);
+struct inode_slot {
+    dev_t dev;
+    ino_t ino;
+    bool  used;
+};
 
-        if (depth == 0) {
-            printf("\n%s:\n", full_path);
-        } else {
-            printf("%s:\n", full_path);
+// Встреченные (st_dev, st_ino); открытая адресация, cap — степень двойки.
+static struct {
+    struct inode_slot* slots;
+    size_t cap, count;
+} inode_set;
+
+static struct outbuf du_buf;     // строки итогов, выводятся после листинга
+
+static uint64_t inode_hash(dev_t dev, ino_t ino) {
+    uint64_t h = (uint64_t)ino * 0x9E3779B97F4A7C15ull ^ (uint64_t)dev * 0xC2B2AE3D27D4EB4Full;
+    return h ^ (h >> 29);
+}
+
+static void inode_set_put(dev_t dev, ino_t ino) {
+    size_t i = (size_t)inode_hash(dev, ino) & (inode_set.cap - 1);
+    while (inode_set.slots[i].used) i = (i + 1) & (inode_set.cap - 1);
+    inode_set.slots[i].dev  = dev;
+    inode_set.slots[i].ino  = ino;
+    inode_set.slots[i].used = true;
+    inode_set.count++;
+}
+
+// true — inode встретился впервые.
+static bool inode_set_insert(dev_t dev, ino_t ino) {
+    if (inode_set.cap) {
+        size_t mask = inode_set.cap - 1;
+        for (size_t i = (size_t)inode_hash(dev, ino) & mask; inode_set.slots[i].used; i = (i + 1) & mask) {
+            if (inode_set.slots[i].ino == ino && inode_set.slots[i].dev == dev) return false;
+        }
+    }
+    if ((inode_set.count + 1) * 2 > inode_set.cap) {
+        struct inode_slot* old = inode_set.slots;
+        size_t old_cap = inode_set.cap;
+        inode_set.cap   = old_cap ? old_cap * 2 : 1024;
+        inode_set.count = 0;
+        inode_set.slots = xmalloc(inode_set.cap * sizeof(*inode_set.slots));
+        memset(inode_set.slots, 0, inode_set.cap * sizeof(*inode_set.slots));
+        for (size_t i = 0; i < old_cap; i++) {
+            if (old[i].used) inode_set_put(old[i].dev, old[i].ino);
         }
+        free(old);
+    }
+    inode_set_put(dev, ino);
+    return true;
+}
+
+static void inode_set_release(void) {
+    free(inode_set.slots);
+    memset(&inode_set, 0, sizeof(inode_set));
+}
 
-        recursive_ls(full_path, depth + 1, fl);
+// Вклад записи i в итог её каталога; own — stat самой записи, без
+// разыменования ссылки. Файл с несколькими ссылками только заявляется.
+static void du_entry_set(struct dir_entries* e, size_t i, const struct stat* own) {
+    e->du_blocks[i] = S_ISDIR(own->st_mode) ? 0 : (uint64_t)own->st_blocks;
+    e->du_ids[i].ino = 0;
+    if (!S_ISDIR(own->st_mode) && own->st_nlink > 1) {
+        e->du_ids[i].dev = own->st_dev;
+        e->du_ids[i].ino = own->st_ino;
     }
 }
 
-static void run(const struct flags* fl) {
-    if (!fl->recursive_flag) {
-        open_dir_and_print_list(".", NULL, NULL, fl);
-    } else {
-        printf(".:\n");
-        recursive_ls(".", 0, fl);
+// Для -s: own — сама запись (ссылка как ссылка) для подсчёта, st — как
+// раньше, цель ссылки для вывода.
+static int du_entry_stat(int dfd, const char* name, unsigned int mask, struct stat* own, struct stat* st) {
+    if (entry_stat(dfd, name, mask, AT_SYMLINK_NOFOLLOW, own) != 0) return -1;
+    if (!S_ISLNK(own->st_mode)) {
+        *st = *own;
+        return 0;
     }
+    return entry_stat(dfd, name, mask, 0, st);
+}
+
+// Заявка на inode: место pos в порядке вывода каталога (0 — сам каталог,
+// i + 1 — i-я выведенная запись).
+struct du_claim {
+    dev_t    dev;
+    ino_t    ino;
+    uint64_t blocks;
+    size_t   pos;
+};
+
+// Блоки одного каталога без подкаталогов, пока не разобранные.
+struct du_dir {
+    uint64_t blocks;             // бесспорные: файлы с одной ссылкой
+    struct du_claim* claims;     // по возрастанию pos; [0] — сам каталог
+    size_t claim_count, claim_cap;
+    size_t* subdir_pos;          // места подкаталогов из subdirs
+    size_t subdir_count, subdir_cap;
+    size_t next;                 // первая неразобранная заявка
+    bool   alias;                // сам каталог уже засчитан по другому пути
+};
+
+static void du_claim_push(struct du_dir* d, dev_t dev, ino_t ino, uint64_t blocks, size_t pos) {
+    if (d->claim_count == d->claim_cap) {
+        d->claim_cap = d->claim_cap ? d->claim_cap * 2 : 16;
+        d->claims    = xrealloc(d->claims, d->claim_cap * sizeof(*d->claims));
+    }
+    d->claims[d->claim_count++] = (struct du_claim){dev, ino, blocks, pos};
+}
+
+static void du_subdir_push(struct du_dir* d, size_t pos) {
+    if (d->subdir_count == d->subdir_cap) {
+        d->subdir_cap = d->subdir_cap ? d->subdir_cap * 2 : 16;
+        d->subdir_pos = xrealloc(d->subdir_pos, d->subdir_cap * sizeof(*d->subdir_pos));
+    }
+    d->subdir_pos[d->subdir_count++] = pos;
+}
+
+// Заявки прочитанного каталога: dir_st — fstat его дескриптора, записи —
+// в порядке вывода.
+static void du_dir_fill(struct du_dir* d, const struct stat* dir_st, const struct dir_reader* rd) {
+    d->blocks = 0;
+    d->claim_count = d->next = 0;
+    d->alias = false;
+    du_claim_push(d, dir_st->st_dev, dir_st->st_ino, (uint64_t)dir_st->st_blocks, 0);
+    for (size_t i = 0; i < rd->count; i++) {
+        size_t idx = rd->refs[i].idx;
+        const struct du_id* id = &rd->ents.du_ids[idx];
+        if (id->ino) du_claim_push(d, id->dev, id->ino, rd->ents.du_blocks[idx], i + 1);
+        else         d->blocks += rd->ents.du_blocks[idx];
+    }
+}
+
+// Засчитать заявки каталога до места pos (не включая). Повторно
+// встреченный каталог (через ссылку) не считается вовсе.
+static uint64_t du_settle(struct du_dir* d, size_t pos) {
+    uint64_t blocks = 0;
+    for (; d->next < d->claim_count && d->claims[d->next].pos < pos; d->next++) {
+        const struct du_claim* c = &d->claims[d->next];
+        bool fresh = !d->alias && inode_set_insert(c->dev, c->ino);
+        if (d->next == 0) {
+            d->alias = !fresh;
+            if (fresh) blocks += d->blocks;
+        }
+        if (fresh) blocks += c->blocks;
+    }
+    return blocks;
+}
+
+static void du_dir_release(struct du_dir* d) {
+    free(d->claims);
+    free(d->subdir_pos);
+    memset(d, 0, sizeof(*d));
+}
+
+// Как du: байты округляются вверх до КиБ.
+static void print_du_line(uint64_t blocks, const char* path) {
+    ob_put_uint(&du_buf, (blocks * 512 + 1023) / 1024, 0);
+    ob_putc(&du_buf, '\t');
+    ob_puts(&du_buf, path);
+    ob_putc(&du_buf, '\n');
+}
+
+static void pending_push(struct dir_reader* rd, uint32_t idx) {
+    if (rd->pending_count == rd->pending_cap) {
+        rd->pending_cap = rd->pending_cap ? rd->pending_cap * 2 : 256;
+        rd->pending     = xrealloc(rd->pending, rd->pending_cap * sizeof(*rd->pending));
+    }
+    rd->pending[rd->pending_count++] = idx;
+}
+
+// statx отложенных записей через кольцо: очередь держится полной, ответы
+// разбираются, как только приходят. Имена лежат в арене, которая уже не
+// растёт, так что указатели на них живут до конца. Запись с неудачным
+// statx получает режим 0 и не выводится — как при stat по одному. С du
+// statx не разыменовывает ссылки, цель ссылки потом спрашивается отдельно.
+static void uring_stat_entries(struct dir_reader* rd, int dfd, unsigned int mask, bool du) {
+    struct uring* r = &rd->ring;
+    struct dir_entries* e = &rd->ents;
+    size_t next = 0, inflight = 0;
+
+    while (next < rd->pending_count || inflight) {
+        while (next < rd->pending_count && r->free_count) {
+            uint32_t idx = rd->pending[next++];
+            uring_queue_statx(r, dfd, arena_name(&e->names, idx), mask, du ? AT_SYMLINK_NOFOLLOW : 0, idx);
+            inflight++;
+        }
+        uring_submit_and_wait(r);
+
+        unsigned head = *r->cq_head;
+        unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            const struct io_uring_cqe* cqe = &r->cqes[head & *r->cq_mask];
+            unsigned slot = (unsigned)cqe->user_data;
+            uint32_t idx  = r->entry[slot];
+            struct stat st;
+            if (cqe->res != 0) {
+                e->modes[idx] = 0;
+            } else {
+                statx_to_stat(&r->stx[slot], &st);
+                if (du) du_entry_set(e, idx, &st);
+                if (du && S_ISLNK(st.st_mode) &&
+                    entry_stat(dfd, arena_name(&e->names, idx), mask, 0, &st) != 0) {
+                    e->modes[idx] = 0;
+                } else {
+                    entries_set(e, idx, &st);
+                }
+            }
+            r->free_slots[r->free_count++] = slot;
+            inflight--;
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+    rd->pending_count = 0;
+}
+
+// ------------------------ Снимок каталогов (-c файл) -------------------------
+//
+// Файл снимка хранит записи каждого показанного каталога вместе с его
+// mtime/ctime, устройством и inode. Следующий запуск делает для каталога
+// один fstat: если ключ совпал, имена берутся из снимка без getdents.
+// Перечитываются только изменившиеся каталоги. В конце запуска снимок
+// пишется заново, целиком, через временный файл и rename().
+//
+// Ключ ловит создание, удаление и переименование записей, но не
+// изменения самих файлов (запись, chmod): mtime каталога они не трогают.
+// Поэтому с -l, -S и -t stat записей делается и при попадании в снимок
+// (пачкой через io_uring с -u) — экономится только чтение каталога. В
+// коротком режиме записи берутся из снимка целиком. Каталог, изменённый
+// в ту же секунду, когда его читали, помечается SNAP_RACY и в следующий
+// раз читается заново. С -s снимок не используется: дедупликации нужны
+// inode всех записей.
+//
+// Формат рассчитан на mmap: заголовок, таблица каталогов по возрастанию
+// пути (двоичный поиск), записи каталогов подряд, строки с '\0'.
+
+#define SNAP_MAGIC "MYLSSNP2"
+
+enum {
+    SNAP_FULL = 1,               // записи с полным stat (-l, -S, -t)
+    SNAP_ALL  = 2,               // со скрытыми (-a)
+    SNAP_RACY = 4,               // каталог менялся во время чтения
+};
+
+struct snap_header {
+    char     magic[8];
+    uint64_t dir_count;
+    uint64_t entry_count;
+    uint64_t strings_size;
+    uint64_t cwd_off;            // каталог запуска: пути в снимке от него
+};
+
+struct snap_dir {
+    uint64_t path_off;
+    uint64_t first_entry;
+    uint32_t entry_count;
+    uint32_t flags;
+    int64_t  mtime_sec, ctime_sec;
+    uint32_t mtime_nsec, ctime_nsec;
+    uint64_t dev, ino;
+};
+
+struct snap_entry {
+    uint64_t name_off;
+    uint64_t size;
+    int64_t  mtime;
+    uint32_t mtime_nsec;
+    uint32_t mode, nlink, uid, gid;
+};
+
+struct snapshot {
+    void*  map;
+    size_t map_size;
+    const struct snap_header* hdr;
+    const struct snap_dir*    dirs;
+    const struct snap_entry*  ents;
+    const char*               strings;
+};
+
+struct snap_builder {
+    pthread_mutex_t    lock;
+    struct snap_dir*   dirs;
+    size_t dir_count, dir_cap;
+    struct snap_entry* ents;
+    size_t ent_count, ent_cap;
+    struct outbuf      strings;
+};
+
+static struct snapshot*   snap_old;    // NULL — снимка нет или он не подошёл
+static struct snap_builder snap_new;
+static time_t             snap_start;
+
+static uint64_t snap_string(struct snap_builder* b, const char* s) {
+    uint64_t off = b->strings.len;
+    ob_write(&b->strings, s, strlen(s) + 1);
+    return off;
+}
+
+// Снимок подходит, если заголовок и размеры сходятся и он снят из того
+// же каталога.
+static struct snapshot* snap_open(const char* file, const char* cwd) {
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct snap_header)) {
+        close(fd);
+        return NULL;
+    }
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    struct snapshot* s = xmalloc(sizeof(*s));
+    s->map      = map;
+    s->map_size = (size_t)st.st_size;
+    s->hdr      = map;
+
+    const struct snap_header* h = s->hdr;
+    size_t dirs_size = 0, ents_size = 0;
+    bool ok = memcmp(h->magic, SNAP_MAGIC, 8) == 0 &&
+              h->dir_count < s->map_size / sizeof(struct snap_dir) &&
+              h->entry_count < s->map_size / sizeof(struct snap_entry);
+    if (ok) {
+        dirs_size = h->dir_count * sizeof(struct snap_dir);
+        ents_size = h->entry_count * sizeof(struct snap_entry);
+        ok = sizeof(*h) + dirs_size + ents_size + h->strings_size == s->map_size &&
+             h->strings_size > 0;
+    }
+    if (ok) {
+        s->dirs    = (const struct snap_dir*)((const char*)map + sizeof(*h));
+        s->ents    = (const struct snap_entry*)((const char*)s->dirs + dirs_size);
+        s->strings = (const char*)s->ents + ents_size;
+        ok = s->strings[h->strings_size - 1] == '\0' && h->cwd_off < h->strings_size &&
+             strcmp(s->strings + h->cwd_off, cwd) == 0;
+    }
+    if (!ok) {
+        munmap(map, s->map_size);
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+static void snap_close(struct snapshot* s) {
+    if (!s) return;
+    munmap(s->map, s->map_size);
+    free(s);
+}
+
+static const struct snap_dir* snap_find(const struct snapshot* s, const char* path) {
+    size_t lo = 0, hi = s->hdr->dir_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const struct snap_dir* d = &s->dirs[mid];
+        if (d->path_off >= s->hdr->strings_size) return NULL;
+        int c = strcmp(s->strings + d->path_off, path);
+        if (c == 0) return d;
+        if (c < 0) lo = mid + 1;
+        else       hi = mid;
+    }
+    return NULL;
+}
+
+static bool snap_key_matches(const struct snap_dir* d, const struct stat* dir_st) {
+    return d->mtime_sec == (int64_t)dir_st->st_mtim.tv_sec &&
+           d->mtime_nsec == (uint32_t)dir_st->st_mtim.tv_nsec &&
+           d->ctime_sec == (int64_t)dir_st->st_ctim.tv_sec &&
+           d->ctime_nsec == (uint32_t)dir_st->st_ctim.tv_nsec &&
+           d->dev == (uint64_t)dir_st->st_dev && d->ino == (uint64_t)dir_st->st_ino;
+}
+
+// Записи каталога из снимка; false — снимок для него не годится.
+// Возвращает флаги содержимого в *flags.
+static bool snap_load(int dfd, const char* path, const struct stat* dir_st, struct dir_reader* rd,
+                      const struct flags* fl, uint32_t* flags) {
+    const struct snapshot* s = snap_old;
+    const struct snap_dir* d = s ? snap_find(s, path) : NULL;
+    if (!d || !snap_key_matches(d, dir_st) || (d->flags & SNAP_RACY)) return false;
+    if (fl->all_flag && !(d->flags & SNAP_ALL)) return false;
+    if (d->first_entry > s->hdr->entry_count || d->entry_count > s->hdr->entry_count - d->first_entry) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < d->entry_count; i++) {
+        const struct snap_entry* e = &s->ents[d->first_entry + i];
+        if (e->name_off >= s->hdr->strings_size) {
+            rd->pending_count = 0;
+            return false;
+        }
+        const char* name = s->strings + e->name_off;
+        if (!fl->all_flag && name[0] == '.') continue;
+
+        struct stat st;
+        memset(&st, 0, sizeof(st));
+        st.st_mode  = e->mode;
+        st.st_size  = (off_t)e->size;
+        st.st_mtim.tv_sec  = (time_t)e->mtime;
+        st.st_mtim.tv_nsec = e->mtime_nsec;
+        st.st_nlink = e->nlink;
+        st.st_uid   = e->uid;
+        st.st_gid   = e->gid;
+        // Размер, время и права файла могли измениться без каталога.
+        if (need_full_stat(fl)) {
+            if (rd->ring.fd >= 0) {
+                pending_push(rd, (uint32_t)rd->ents.names.count);
+            } else if (entry_stat(dfd, name, LONG_STATX_MASK, 0, &st) != 0) {
+                continue;
+            }
+        }
+        entries_push(&rd->ents, name, strlen(name), &st);
+    }
+    if (rd->pending_count) uring_stat_entries(rd, dfd, LONG_STATX_MASK, false);
+    *flags = (need_full_stat(fl) ? SNAP_FULL : (d->flags & SNAP_FULL)) | (fl->all_flag ? SNAP_ALL : 0);
+    return true;
+}
+
+// Записи прочитанного каталога — в новый снимок. Зовётся из потоков обхода.
+static void snap_record(const char* path, const struct stat* dir_st, const struct dir_entries* e,
+                        uint32_t flags) {
+    if (dir_st->st_mtim.tv_sec >= snap_start - 1 || dir_st->st_ctim.tv_sec >= snap_start - 1) {
+        flags |= SNAP_RACY;
+    }
+
+    struct snap_builder* b = &snap_new;
+    pthread_mutex_lock(&b->lock);
+    if (b->dir_count == b->dir_cap) {
+        b->dir_cap = b->dir_cap ? b->dir_cap * 2 : 256;
+        b->dirs    = xrealloc(b->dirs, b->dir_cap * sizeof(*b->dirs));
+    }
+    struct snap_dir* d = &b->dirs[b->dir_count++];
+    memset(d, 0, sizeof(*d));
+    d->path_off    = snap_string(b, path);
+    d->first_entry = b->ent_count;
+    d->flags       = flags;
+    d->mtime_sec   = (int64_t)dir_st->st_mtim.tv_sec;
+    d->mtime_nsec  = (uint32_t)dir_st->st_mtim.tv_nsec;
+    d->ctime_sec   = (int64_t)dir_st->st_ctim.tv_sec;
+    d->ctime_nsec  = (uint32_t)dir_st->st_ctim.tv_nsec;
+    d->dev         = (uint64_t)dir_st->st_dev;
+    d->ino         = (uint64_t)dir_st->st_ino;
+
+    for (size_t i = 0; i < e->names.count; i++) {
+        if (e->modes[i] == 0) continue;
+        if (b->ent_count == b->ent_cap) {
+            b->ent_cap = b->ent_cap ? b->ent_cap * 2 : 1024;
+            b->ents    = xrealloc(b->ents, b->ent_cap * sizeof(*b->ents));
+        }
+        struct snap_entry* se = &b->ents[b->ent_count++];
+        se->name_off = snap_string(b, arena_name(&e->names, i));
+        se->size     = (uint64_t)e->sizes[i];
+        se->mtime    = (int64_t)e->mtimes[i];
+        se->mtime_nsec = e->mtime_nsecs[i];
+        se->mode     = (uint32_t)e->modes[i];
+        se->nlink    = (uint32_t)e->nlinks[i];
+        se->uid      = (uint32_t)e->uids[i];
+        se->gid      = (uint32_t)e->gids[i];
+        d->entry_count++;
+    }
+    pthread_mutex_unlock(&b->lock);
+}
+
+static int snap_dir_cmp(const void* a, const void* b, void* strings) {
+    const struct snap_dir* x = a;
+    const struct snap_dir* y = b;
+    return strcmp((const char*)strings + x->path_off, (const char*)strings + y->path_off);
+}
+
+static bool use_snapshot(const struct flags* fl) {
+    return fl->cache_path && !fl->du_flag;
+}
+
+static void snap_init(const struct flags* fl) {
+    char* cwd = realpath(".", NULL);
+    if (!cwd) {
+        perror("realpath");
+        exit(1);
+    }
+    snap_start = time(NULL);
+    snap_old   = snap_open(fl->cache_path, cwd);
+
+    memset(&snap_new, 0, sizeof(snap_new));
+    pthread_mutex_init(&snap_new.lock, NULL);
+    ob_init(&snap_new.strings, -1);
+    snap_string(&snap_new, cwd);             // cwd_off == 0
+    free(cwd);
+}
+
+// Новый снимок — во временный файл рядом и rename() поверх старого:
+// параллельный запуск увидит либо старый снимок, либо новый целиком.
+static void snap_finish(const struct flags* fl) {
+    struct snap_builder* b = &snap_new;
+    qsort_r(b->dirs, b->dir_count, sizeof(*b->dirs), snap_dir_cmp, b->strings.data);
+
+    size_t tmp_len = strlen(fl->cache_path) + 32;
+    char* tmp = xmalloc(tmp_len);
+    snprintf(tmp, tmp_len, "%s.%ld.tmp", fl->cache_path, (long)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("unable to write snapshot");
+        exit(1);
+    }
+
+    struct snap_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAP_MAGIC, 8);
+    h.dir_count    = b->dir_count;
+    h.entry_count  = b->ent_count;
+    h.strings_size = b->strings.len;
+    h.cwd_off      = 0;
+
+    struct outbuf out;
+    ob_init(&out, fd);
+    ob_write(&out, (const char*)&h, sizeof(h));
+    ob_write(&out, (const char*)b->dirs, b->dir_count * sizeof(*b->dirs));
+    ob_write(&out, (const char*)b->ents, b->ent_count * sizeof(*b->ents));
+    ob_write(&out, b->strings.data, b->strings.len);
+    ob_flush(&out);
+    free(out.data);
+
+    if (close(fd) != 0 || rename(tmp, fl->cache_path) != 0) {
+        perror("unable to write snapshot");
+        unlink(tmp);
+        exit(1);
+    }
+    free(tmp);
+
+    snap_close(snap_old);
+    snap_old = NULL;
+    free(b->dirs);
+    free(b->ents);
+    free(b->strings.data);
+    pthread_mutex_destroy(&b->lock);
+}
+
+// Записи каталога dfd в rd->ents: getdents64 и stat там, где их нужно.
+static void read_entries(int dfd, struct dir_reader* rd, const struct flags* fl) {
+    struct stat file_stat;
+    unsigned int mask = need_full_stat(fl) ? LONG_STATX_MASK : SHORT_STATX_MASK;
+    if (fl->du_flag) mask |= DU_STATX_MASK;
+    char* dents = rd->dents;
+    arena_clear(&rd->ents.names);
+
+    for (;;) {
+        long nread = syscall(SYS_getdents64, dfd, dents, DENTS_BUF_SIZE);
+        if (nread < 0) {
+            perror("getdents64");
+            exit(1);
+        }
+        if (nread == 0) break;
+
+        for (long pos = 0; pos < nread; ) {
+            struct linux_dirent64* entry = (struct linux_dirent64*)(dents + pos);
+            pos += entry->d_reclen;
+
+            if (!fl->all_flag && entry->d_name[0] == '.') continue;
+
+            struct stat own;
+            bool counted = false;
+            if (!need_stat(entry->d_type, fl)) {
+                memset(&file_stat, 0, sizeof(file_stat));
+                file_stat.st_mode = DTTOIF(entry->d_type);
+            } else if (rd->ring.fd >= 0) {
+                memset(&file_stat, 0, sizeof(file_stat));
+                pending_push(rd, (uint32_t)rd->ents.names.count);
+            } else if (fl->du_flag) {
+                if (du_entry_stat(dfd, entry->d_name, mask, &own, &file_stat) != 0) continue;
+                counted = true;
+            } else if (entry_stat(dfd, entry->d_name, mask, 0, &file_stat) != 0) {
+                continue;
+            }
+
+            entries_push(&rd->ents, entry->d_name, strlen(entry->d_name), &file_stat);
+            if (counted) du_entry_set(&rd->ents, rd->ents.names.count - 1, &own);
+        }
+    }
+    if (rd->pending_count) uring_stat_entries(rd, dfd, mask, fl->du_flag);
+}
+
+static char* join_path(const char* dir, const char* name) {
+    size_t len = strlen(dir) + strlen(name) + 2;
+    char* full_path = xmalloc(len);
+    snprintf(full_path, len, "%s/%s", dir, name);
+    return full_path;
+}
+
+// ---------------------------- Наблюдение (-w) --------------------------------
+//
+// После первого обхода myls -w не выходит: дерево остаётся в памяти
+// (каталог -> хеш-таблица имён), на каждый показанный каталог ставится
+// inotify, а события превращаются в строки изменений:
+//     + путь    запись появилась
+//     - путь    запись исчезла
+//     ~ путь    изменилось то, что видно в выводе
+// С -l после знака идёт строка листинга с путём вместо имени, и "~"
+// значит любое изменение этой строки; без -l — только смену цвета.
+// Событие трогает одну запись одного каталога (и строку самого каталога
+// у родителя), так что работа пропорциональна числу изменений, а не
+// размеру дерева. Новый каталог читается целиком, исчезнувший снимается
+// со всем поддеревом.
+//
+// -R идёт и по ссылкам на каталоги, так что один каталог может попасть
+// в индекс под несколькими путями. У них общий wd: by_wd[wd] — список
+// узлов, событие применяется к каждому, а watch снимается с последним.
+//
+// Если inotify упирается в предел (max_user_watches), каталог остаётся
+// без watch и пересматривается раз в WATCH_RESCAN_MS — с новой попыткой
+// его поставить. При переполнении очереди событий пересматривается всё
+// дерево. Итоги -s не обновляются.
+
+#define WATCH_RESCAN_MS 2000
+#define WATCH_EVENT_BUF (64 * 1024)
+
+struct watch_dir;
+
+struct watch_entry {
+    char*    name;               // NULL — пусто, watch_tomb — удалена
+    struct watch_dir* sub;       // для подкаталога с -R — его узел
+    mode_t   mode;
+    nlink_t  nlink;
+    uid_t    uid;
+    gid_t    gid;
+    off_t    size;
+    struct timespec mtime;
+    unsigned seen;               // поколение последнего пересмотра
+};
+
+struct watch_dir {
+    char*  path;
+    int    wd;                   // -1 — без inotify, пересматривается
+    size_t index;                // место в watch.dirs
+    struct watch_dir*   alias;   // следующий узел с тем же wd
+    struct watch_dir*   parent;
+    struct watch_entry* slots;   // открытая адресация по имени
+    size_t cap, used, count;     // used — занятые слоты вместе с удалёнными
+};
+
+struct watch_index {
+    pthread_mutex_t lock;        // первый обход идёт и из потоков -j
+    int      fd;
+    uint32_t mask;
+    struct watch_dir** dirs;
+    size_t dir_count, dir_cap;
+    struct watch_dir** by_wd;
+    size_t wd_cap;
+    size_t unwatched;
+    bool   warned;
+    unsigned gen;
+    const struct flags* fl;
+};
+
+static struct watch_index watch;
+static char watch_tomb_mark;
+#define watch_tomb (&watch_tomb_mark)
+
+static uint64_t name_hash(const char* s) {
+    uint64_t h = 1469598103934665603ull;
+    for (; *s; s++) h = (h ^ (unsigned char)*s) * 1099511628211ull;
+    return h;
+}
+
+static bool slot_live(const struct watch_entry* e) {
+    return e->name && e->name != watch_tomb;
+}
+
+static struct watch_entry* wdir_find(struct watch_dir* d, const char* name) {
+    if (!d->cap) return NULL;
+    for (size_t i = name_hash(name) & (d->cap - 1); d->slots[i].name; i = (i + 1) & (d->cap - 1)) {
+        if (slot_live(&d->slots[i]) && strcmp(d->slots[i].name, name) == 0) return &d->slots[i];
+    }
+    return NULL;
+}
+
+static void wdir_set(struct watch_entry* e, const struct stat* st) {
+    e->mode  = st->st_mode;
+    e->nlink = st->st_nlink;
+    e->uid   = st->st_uid;
+    e->gid   = st->st_gid;
+    e->size  = st->st_size;
+    e->mtime = st->st_mtim;
+}
+
+static void wdir_get(const struct watch_entry* e, struct stat* st) {
+    memset(st, 0, sizeof(*st));
+    st->st_mode  = e->mode;
+    st->st_nlink = e->nlink;
+    st->st_uid   = e->uid;
+    st->st_gid   = e->gid;
+    st->st_size  = e->size;
+    st->st_mtim  = e->mtime;
+}
+
+// Указатели на записи живут до следующей вставки в тот же каталог.
+static struct watch_entry* wdir_insert(struct watch_dir* d, const char* name, const struct stat* st) {
+    if ((d->used + 1) * 2 > d->cap) {
+        struct watch_entry* old = d->slots;
+        size_t old_cap = d->cap;
+        d->cap = 16;
+        while (d->cap < (d->count + 1) * 4) d->cap *= 2;
+        d->slots = xmalloc(d->cap * sizeof(*d->slots));
+        memset(d->slots, 0, d->cap * sizeof(*d->slots));
+        d->used = d->count;
+        for (size_t i = 0; i < old_cap; i++) {
+            if (!slot_live(&old[i])) continue;
+            size_t j = name_hash(old[i].name) & (d->cap - 1);
+            while (d->slots[j].name) j = (j + 1) & (d->cap - 1);
+            d->slots[j] = old[i];
+        }
+        free(old);
+    }
+
+    size_t i = name_hash(name) & (d->cap - 1);
+    while (slot_live(&d->slots[i])) i = (i + 1) & (d->cap - 1);
+    if (!d->slots[i].name) d->used++;
+    struct watch_entry* e = &d->slots[i];
+    memset(e, 0, sizeof(*e));
+    e->name = strdup(name);
+    wdir_set(e, st);
+    d->count++;
+    return e;
+}
+
+static void wdir_remove(struct watch_dir* d, struct watch_entry* e) {
+    free(e->name);
+    e->name = watch_tomb;
+    e->sub  = NULL;
+    d->count--;
+}
+
+static void watch_init(const struct flags* fl) {
+    watch.fd = inotify_init1(IN_CLOEXEC);
+    if (watch.fd < 0) {
+        perror("inotify_init1");
+        exit(1);
+    }
+    watch.mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_ONLYDIR;
+    if (need_full_stat(fl)) watch.mask |= IN_CLOSE_WRITE;     // размер и время в -l
+    watch.fl = fl;
+    pthread_mutex_init(&watch.lock, NULL);
+}
+
+// watch на каталог; -1 — поставить не удалось, каталог будет
+// пересматриваться. Ставится до чтения каталога, так что изменения после
+// чтения не теряются.
+static int watch_add(const char* path) {
+    int wd = inotify_add_watch(watch.fd, path, watch.mask);
+    if (wd < 0 && (errno == ENOSPC || errno == ENOMEM)) {
+        pthread_mutex_lock(&watch.lock);
+        if (!watch.warned) {
+            fprintf(stderr, "myls: inotify watch limit reached, rescanning unwatched directories every %d ms\n",
+                    WATCH_RESCAN_MS);
+            watch.warned = true;
+        }
+        pthread_mutex_unlock(&watch.lock);
+    }
+    return wd;
+}
+
+static void watch_bind(struct watch_dir* d, int wd) {
+    d->wd = wd;
+    if (wd < 0) {
+        watch.unwatched++;
+        return;
+    }
+    if ((size_t)wd >= watch.wd_cap) {
+        size_t cap = watch.wd_cap ? watch.wd_cap : 256;
+        while (cap <= (size_t)wd) cap *= 2;
+        watch.by_wd = xrealloc(watch.by_wd, cap * sizeof(*watch.by_wd));
+        memset(watch.by_wd + watch.wd_cap, 0, (cap - watch.wd_cap) * sizeof(*watch.by_wd));
+        watch.wd_cap = cap;
+    }
+    d->alias = watch.by_wd[wd];
+    watch.by_wd[wd] = d;
+}
+
+static bool watch_wd_used(int wd) {
+    return wd >= 0 && (size_t)wd < watch.wd_cap && watch.by_wd[wd];
+}
+
+// Узел больше не следит за своим wd; сам watch снимается, только если
+// других узлов на нём не осталось.
+static void watch_unbind(struct watch_dir* d) {
+    if (d->wd < 0) {
+        watch.unwatched--;
+        return;
+    }
+    struct watch_dir** p = &watch.by_wd[d->wd];
+    while (*p != d) p = &(*p)->alias;
+    *p = d->alias;
+    if (!watch.by_wd[d->wd]) inotify_rm_watch(watch.fd, d->wd);   // у удалённого уже снят — EINVAL
+    d->alias = NULL;
+    d->wd    = -1;
+}
+
+// Прочитанный каталог — в индекс.
+static struct watch_dir* watch_record(const char* path, int wd, const struct dir_entries* e) {
+    pthread_mutex_lock(&watch.lock);
+    struct watch_dir* d = xmalloc(sizeof(*d));
+    memset(d, 0, sizeof(*d));
+    d->path = strdup(path);
+    if (watch.dir_count == watch.dir_cap) {
+        watch.dir_cap = watch.dir_cap ? watch.dir_cap * 2 : 256;
+        watch.dirs    = xrealloc(watch.dirs, watch.dir_cap * sizeof(*watch.dirs));
+    }
+    d->index = watch.dir_count;
+    watch.dirs[watch.dir_count++] = d;
+    watch_bind(d, wd);
+
+    struct stat st;
+    for (size_t i = 0; i < e->names.count; i++) {
+        if (e->modes[i] == 0) continue;
+        entry_stat_at(e, i, &st);
+        wdir_insert(d, arena_name(&e->names, i), &st);
+    }
+    pthread_mutex_unlock(&watch.lock);
+    return d;
+}
+
+static int watch_dir_cmp(const void* a, const void* b) {
+    return strcmp((*(struct watch_dir* const*)a)->path, (*(struct watch_dir* const*)b)->path);
+}
+
+// Первый обход читает каталоги в любом порядке (и в нескольких потоках),
+// поэтому связи родитель — подкаталог проставляются после него, одним
+// проходом по отсортированным путям.
+static void watch_link(void) {
+    struct watch_dir** sorted = xmalloc((watch.dir_count + 1) * sizeof(*sorted));
+    memcpy(sorted, watch.dirs, watch.dir_count * sizeof(*sorted));
+    qsort(sorted, watch.dir_count, sizeof(*sorted), watch_dir_cmp);
+
+    for (size_t i = 0; i < watch.dir_count; i++) {
+        struct watch_dir* d = sorted[i];
+        const char* slash = strrchr(d->path, '/');
+        if (!slash) continue;
+        struct watch_dir key = {.path = strndup(d->path, (size_t)(slash - d->path))};
+        struct watch_dir* pkey = &key;
+        struct watch_dir** p = bsearch(&pkey, sorted, watch.dir_count, sizeof(*sorted), watch_dir_cmp);
+        free(key.path);
+        if (!p) continue;
+        struct watch_entry* e = wdir_find(*p, slash + 1);
+        if (!e) continue;
+        e->sub    = d;
+        d->parent = *p;
+    }
+    free(sorted);
+}
+
+static void emit_change(char op, const struct watch_dir* d, const char* name, const struct stat* st) {
+    char* path = join_path(d->path, name);
+    ob_putc(&stdout_buf, op);
+    ob_putc(&stdout_buf, ' ');
+    if (need_full_stat(watch.fl)) {
+        struct long_widths w = {3, 8, 8, 8};
+        print_long_entry(&stdout_buf, path, st, &w);
+    } else {
+        const char* color = name_color(st->st_mode, false);
+        if (color) ob_puts(&stdout_buf, color);
+        ob_puts(&stdout_buf, path);
+        if (color) ob_puts(&stdout_buf, RESET);
+        ob_putc(&stdout_buf, '\n');
+    }
+    free(path);
+}
+
+static bool display_differs(const struct watch_entry* e, const struct stat* st) {
+    if (!need_full_stat(watch.fl)) return name_color(e->mode, false) != name_color(st->st_mode, false);
+    return e->mode != st->st_mode || e->nlink != st->st_nlink || e->uid != st->st_uid ||
+           e->gid != st->st_gid || e->size != st->st_size ||
+           e->mtime.tv_sec != st->st_mtim.tv_sec || e->mtime.tv_nsec != st->st_mtim.tv_nsec;
+}
+
+static bool watch_descends(const struct watch_entry* e) {
+    return watch.fl->recursive_flag && S_ISDIR(e->mode) &&
+           strcmp(e->name, ".") != 0 && strcmp(e->name, "..") != 0;
+}
+
+// Узел снимается со всем поддеревом: "-" на каждую запись внутри.
+static void watch_drop(struct watch_dir* d) {
+    struct stat st;
+    for (size_t i = 0; i < d->cap; i++) {
+        struct watch_entry* e = &d->slots[i];
+        if (!slot_live(e)) continue;
+        if (e->sub) watch_drop(e->sub);
+        wdir_get(e, &st);
+        emit_change('-', d, e->name, &st);
+        free(e->name);
+    }
+    watch_unbind(d);
+    struct watch_dir* last = watch.dirs[--watch.dir_count];
+    watch.dirs[d->index] = last;
+    last->index = d->index;
+    free(d->slots);
+    free(d->path);
+    free(d);
+}
+
+// Новый подкаталог e каталога d: watch, затем чтение — "+" на каждую
+// запись, и так вниз.
+static void watch_add_subtree(struct watch_dir* d, struct watch_entry* e, struct dir_reader* rd) {
+    char* path = join_path(d->path, e->name);
+    int wd = watch_add(path);
+    int dfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0) {
+        if (wd >= 0 && !watch_wd_used(wd)) inotify_rm_watch(watch.fd, wd);
+        free(path);
+        return;
+    }
+    read_entries(dfd, rd, watch.fl);
+    close(dfd);
+    struct watch_dir* sub = watch_record(path, wd, &rd->ents);
+    sub->parent = d;
+    e->sub      = sub;
+    free(path);
+
+    struct stat st;
+    for (size_t i = 0; i < sub->cap; i++) {
+        if (!slot_live(&sub->slots[i])) continue;
+        wdir_get(&sub->slots[i], &st);
+        emit_change('+', sub, sub->slots[i].name, &st);
+    }
+    for (size_t i = 0; i < sub->cap; i++) {
+        if (slot_live(&sub->slots[i]) && watch_descends(&sub->slots[i])) {
+            watch_add_subtree(sub, &sub->slots[i], rd);
+        }
+    }
+}
+
+// Запись name каталога d — по её нынешнему состоянию.
+static void watch_refresh(struct watch_dir* d, const char* name, struct dir_reader* rd) {
+    if (!watch.fl->all_flag && name[0] == '.') return;
+
+    char* path = join_path(d->path, name);
+    struct stat st;
+    bool exists = entry_stat(AT_FDCWD, path, LONG_STATX_MASK, 0, &st) == 0;
+    free(path);
+    struct watch_entry* e = wdir_find(d, name);
+
+    if (e && (!exists || S_ISDIR(e->mode) != S_ISDIR(st.st_mode))) {
+        struct stat old;
+        wdir_get(e, &old);
+        if (e->sub) watch_drop(e->sub);
+        emit_change('-', d, name, &old);
+        wdir_remove(d, e);
+        e = NULL;
+    }
+    if (exists && !e) {
+        e = wdir_insert(d, name, &st);
+        emit_change('+', d, name, &st);
+        if (watch_descends(e)) watch_add_subtree(d, e, rd);
+    } else if (exists && display_differs(e, &st)) {
+        wdir_set(e, &st);
+        emit_change('~', d, name, &st);
+    }
+}
+
+// Изменился сам каталог (время, число ссылок, права): "." внутри него и
+// его строка у родителя. Видно только в -l.
+static void watch_touch(struct watch_dir* d, struct dir_reader* rd) {
+    if (!need_full_stat(watch.fl)) return;
+    if (watch.fl->all_flag) watch_refresh(d, ".", rd);
+    if (d->parent) {
+        char* name = strdup(strrchr(d->path, '/') + 1);
+        watch_refresh(d->parent, name, rd);          // может снять и сам d
+        free(name);
+    }
+}
+
+// Пересмотр каталога целиком: без watch или после потерянных событий.
+// Расхождения с индексом разбирает watch_refresh(); имена копируются —
+// rd переиспользуется при чтении новых подкаталогов.
+static void watch_rescan(struct watch_dir* d, struct dir_reader* rd) {
+    if (d->wd < 0) {
+        int wd = watch_add(d->path);
+        if (wd >= 0) {
+            watch.unwatched--;
+            watch_bind(d, wd);
+        }
+    }
+    int dfd = open(d->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0) return;                        // исчез — разберётся родитель
+    read_entries(dfd, rd, watch.fl);
+    close(dfd);
+
+    unsigned gen = ++watch.gen;
+    struct name_arena todo = {0};
+    struct stat st;
+    for (size_t i = 0; i < rd->ents.names.count; i++) {
+        if (rd->ents.modes[i] == 0) continue;
+        const char* name = arena_name(&rd->ents.names, i);
+        struct watch_entry* e = wdir_find(d, name);
+        entry_stat_at(&rd->ents, i, &st);
+        if (e) e->seen = gen;
+        if (!e || display_differs(e, &st)) arena_push(&todo, name, strlen(name));
+    }
+    for (size_t i = 0; i < d->cap; i++) {
+        const struct watch_entry* e = &d->slots[i];
+        if (slot_live(e) && e->seen != gen) arena_push(&todo, e->name, strlen(e->name));
+    }
+    for (size_t i = 0; i < todo.count; i++) watch_refresh(d, arena_name(&todo, i), rd);
+    arena_release(&todo);
+}
+
+// С конца: watch_drop() переносит на место снятого последний узел, а
+// добавленные по ходу только что прочитаны.
+static void watch_rescan_all(bool unwatched_only, struct dir_reader* rd) {
+    for (size_t k = watch.dir_count; k-- > 0; ) {
+        if (k >= watch.dir_count) continue;
+        struct watch_dir* d = watch.dirs[k];
+        if (!unwatched_only || d->wd < 0) watch_rescan(d, rd);
+    }
+}
+
+static void watch_event(const struct inotify_event* ev, struct dir_reader* rd) {
+    if (ev->mask & IN_Q_OVERFLOW) {
+        watch_rescan_all(false, rd);
+        return;
+    }
+    if (!watch_wd_used(ev->wd)) return;
+
+    if (ev->mask & IN_IGNORED) {
+        // watch снят ядром: каталог удалён (это покажет родитель) или его
+        // ФС отмонтирована — дальше только пересмотры.
+        struct watch_dir* d = watch.by_wd[ev->wd];
+        watch.by_wd[ev->wd] = NULL;
+        while (d) {
+            struct watch_dir* next = d->alias;
+            d->alias = NULL;
+            watch_bind(d, -1);
+            d = next;
+        }
+        return;
+    }
+
+    // Обработка одного пути может снять другие (ссылка внутри каталога на
+    // него же), поэтому каждый узел списка перед обработкой ищется заново.
+    size_t count = 0;
+    for (struct watch_dir* d = watch.by_wd[ev->wd]; d; d = d->alias) count++;
+    struct watch_dir** aliases = xmalloc(count * sizeof(*aliases));
+    count = 0;
+    for (struct watch_dir* d = watch.by_wd[ev->wd]; d; d = d->alias) aliases[count++] = d;
+
+    for (size_t i = 0; i < count; i++) {
+        struct watch_dir* d = watch.by_wd[ev->wd];
+        while (d && d != aliases[i]) d = d->alias;
+        if (!d) continue;
+        if (ev->len) watch_refresh(d, ev->name, rd);
+        if (!ev->len || (ev->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO))) watch_touch(d, rd);
+    }
+    free(aliases);
+}
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+// Не возвращается: изменения печатаются пачкой на каждый read().
+static void watch_loop(const struct flags* fl) {
+    watch_link();
+    ob_flush(&stdout_buf);
+
+    struct dir_reader rd;
+    reader_init(&rd, fl);
+    char* buf = xmalloc(WATCH_EVENT_BUF);
+    uint64_t last_rescan = now_ms();
+
+    for (;;) {
+        int timeout = -1;
+        if (watch.unwatched) {
+            uint64_t elapsed = now_ms() - last_rescan;
+            timeout = elapsed >= WATCH_RESCAN_MS ? 0 : (int)(WATCH_RESCAN_MS - elapsed);
+        }
+        struct pollfd pfd = {.fd = watch.fd, .events = POLLIN};
+        int ready = poll(&pfd, 1, timeout);
+        if (ready < 0 && errno != EINTR) {
+            perror("poll");
+            exit(1);
+        }
+
+        if (ready > 0) {
+            ssize_t len = read(watch.fd, buf, WATCH_EVENT_BUF);
+            if (len < 0 && errno != EINTR && errno != EAGAIN) {
+                perror("read inotify");
+                exit(1);
+            }
+            for (ssize_t pos = 0; pos < len; ) {
+                const struct inotify_event* ev = (const struct inotify_event*)(buf + pos);
+                pos += (ssize_t)(sizeof(*ev) + ev->len);
+                watch_event(ev, &rd);
+            }
+        }
+        if (watch.unwatched && now_ms() - last_rescan >= WATCH_RESCAN_MS) {
+            watch_rescan_all(true, &rd);
+            last_rescan = now_ms();
+        }
+        ob_flush(&stdout_buf);
+    }
+}
+
+// Вывод одного каталога; имена подкаталогов (без "." и "..") — в subdirs,
+// если он задан, в порядке вывода. С -s в du — заявки каталога без
+// подкаталогов.
+static void open_dir_and_print_list(struct outbuf* out, const char* const path, struct dir_reader* rd,
+                                    struct name_arena* subdirs, struct du_dir* du, const struct flags* fl) {
+    int dfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0) {
+        perror("unable to open directory");
+        exit(1);
+    }
+
+    if (subdirs) {
+        arena_clear(subdirs);
+    }
+
+    struct stat dir_st;
+    bool snap = use_snapshot(fl);
+    if ((fl->du_flag || snap) && fstat(dfd, &dir_st) != 0) {
+        perror("fstat");
+        exit(1);
+    }
+
+    int wd = fl->watch_flag ? watch_add(path) : -1;
+    uint32_t snap_flags = 0;
+    arena_clear(&rd->ents.names);
+    if (!snap || !snap_load(dfd, path, &dir_st, rd, fl, &snap_flags)) {
+        read_entries(dfd, rd, fl);
+        snap_flags = (need_full_stat(fl) ? SNAP_FULL : 0) | (fl->all_flag ? SNAP_ALL : 0);
+    }
+    if (snap) snap_record(path, &dir_st, &rd->ents, snap_flags);
+    if (fl->watch_flag) watch_record(path, wd, &rd->ents);
+    close(dfd);
+
+    sort_entries(rd, fl);
+    print_list(out, rd, fl);
+
+    if (du) {
+        du_dir_fill(du, &dir_st, rd);
+        du->subdir_count = 0;
+    }
+    if (subdirs) {
+        for (size_t i = 0; i < rd->count; i++) {
+            const struct sort_ref* r = &rd->refs[i];
+            if (S_ISDIR(rd->ents.modes[r->idx]) && strcmp(r->name, ".") != 0 && strcmp(r->name, "..") != 0) {
+                arena_push(subdirs, r->name, strlen(r->name));
+                if (du) du_subdir_push(du, i + 1);
+            }
+        }
+    }
+}
+
+// На стеке уровня — только пара указателей: имена подкаталогов и путь в куче.
+// Возвращает итог -s для поддерева.
+static uint64_t recursive_ls(const char* path, int depth, struct dir_reader* rd, const struct flags* fl) {
+    struct name_arena subdirs = {0};
+    struct du_dir du = {0};
+    uint64_t blocks = 0;
+
+    open_dir_and_print_list(&stdout_buf, path, rd, &subdirs, fl->du_flag ? &du : NULL, fl);
+
+    for (size_t i = 0; i < subdirs.count; i++) {
+        char* full_path = join_path(path, arena_name(&subdirs, i));
+
+        print_header(&stdout_buf, full_path, depth);
+
+        if (fl->du_flag) blocks += du_settle(&du, du.subdir_pos[i]);
+        blocks += recursive_ls(full_path, depth + 1, rd, fl);
+        free(full_path);
+    }
+    arena_release(&subdirs);
+    if (fl->du_flag) {
+        blocks += du_settle(&du, SIZE_MAX);
+        du_dir_release(&du);
+        print_du_line(blocks, path);
+    }
+    return blocks;
+}
+
+// ----------------------- Параллельный обход (-R -j N) -----------------------
+//
+// Каждый каталог — узел дерева. Потоки берут узлы из своих деков (с хвоста)
+// и воруют из чужих (с головы), читают каталог в собственный буфер
+// (outbuf) и кладут подкаталоги к себе. Главный поток выводит
+// буферы в том же порядке, что и recursive_ls(): узел, затем его
+// подкаталоги по порядку, дожидаясь каждого.
+
+struct dir_node {
+    char*  path;
+    int    depth;
+    char*  out;                    // вывод каталога
+    size_t out_len;
+    struct dir_node** children;    // в порядке чтения каталога
+    size_t child_count;
+    struct du_dir du;              // -s: заявки каталога без подкаталогов
+    bool   done;                   // под walker.lock
+};
+
+struct node_deque {
+    pthread_mutex_t lock;
+    struct dir_node** items;       // кольцо
+    size_t head, count, cap;
+};
+
+struct walker {
+    pthread_mutex_t lock;
+    pthread_cond_t  work_cv;       // появилась работа или обход закончен
+    pthread_cond_t  done_cv;       // очередной каталог прочитан
+    size_t queued;                 // узлы в деках
+    size_t pending;                // узлы в деках и в обработке
+    struct node_deque* deques;
+    int nthreads;
+    const struct flags* fl;
+};
+
+struct walker_thread {
+    struct walker* w;
+    int self;
+};
+
+static struct dir_node* node_new(const char* parent, const char* name, int depth) {
+    struct dir_node* node = xmalloc(sizeof(*node));
+    memset(node, 0, sizeof(*node));
+    node->path = parent ? join_path(parent, name) : strdup(name);
+    node->depth = depth;
+    return node;
+}
+
+static void deque_push(struct node_deque* dq, struct dir_node* node) {
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count == dq->cap) {
+        size_t cap = dq->cap ? dq->cap * 2 : 64;
+        struct dir_node** items = xmalloc(cap * sizeof(*items));
+        for (size_t i = 0; i < dq->count; i++) items[i] = dq->items[(dq->head + i) % dq->cap];
+        free(dq->items);
+        dq->items = items;
+        dq->head  = 0;
+        dq->cap   = cap;
+    }
+    dq->items[(dq->head + dq->count) % dq->cap] = node;
+    dq->count++;
+    pthread_mutex_unlock(&dq->lock);
+}
+
+// Свой дек — с хвоста (только что найденные подкаталоги, горячий кэш),
+// чужой — с головы (самые старые и, скорее всего, самые крупные поддеревья).
+static struct dir_node* deque_take(struct node_deque* dq, bool own) {
+    struct dir_node* node = NULL;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count) {
+        if (own) {
+            node = dq->items[(dq->head + dq->count - 1) % dq->cap];
+        } else {
+            node = dq->items[dq->head];
+            dq->head = (dq->head + 1) % dq->cap;
+        }
+        dq->count--;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return node;
+}
+
+static void walker_push(struct walker* w, int self, struct dir_node* node) {
+    deque_push(&w->deques[self], node);
+    pthread_mutex_lock(&w->lock);
+    w->queued++;
+    w->pending++;
+    pthread_cond_signal(&w->work_cv);
+    pthread_mutex_unlock(&w->lock);
+}
+
+static struct dir_node* walker_take(struct walker* w, int self) {
+    for (int i = 0; i < w->nthreads; i++) {
+        struct dir_node* node = deque_take(&w->deques[(self + i) % w->nthreads], i == 0);
+        if (node) {
+            pthread_mutex_lock(&w->lock);
+            w->queued--;
+            pthread_mutex_unlock(&w->lock);
+            return node;
+        }
+    }
+    return NULL;
+}
+
+static void walk_node(struct walker* w, int self, struct dir_node* node, struct dir_reader* rd,
+                      struct name_arena* subdirs) {
+    struct outbuf out;
+    ob_init(&out, -1);
+    open_dir_and_print_list(&out, node->path, rd, subdirs, w->fl->du_flag ? &node->du : NULL, w->fl);
+    node->out     = out.data;
+    node->out_len = out.len;
+
+    size_t subdir_count = subdirs->count;
+    node->child_count = subdir_count;
+    node->children = subdir_count ? xmalloc(subdir_count * sizeof(*node->children)) : NULL;
+    for (size_t i = 0; i < subdir_count; i++) {
+        node->children[i] = node_new(node->path, arena_name(subdirs, i), node->depth + 1);
+    }
+    // В обратном порядке: первый подкаталог окажется на хвосте и будет
+    // взят этим же потоком первым — как при последовательном обходе.
+    for (size_t i = subdir_count; i-- > 0; ) {
+        walker_push(w, self, node->children[i]);
+    }
+
+    pthread_mutex_lock(&w->lock);
+    node->done = true;
+    w->pending--;
+    pthread_cond_broadcast(&w->done_cv);
+    if (w->pending == 0) pthread_cond_broadcast(&w->work_cv);
+    pthread_mutex_unlock(&w->lock);
+}
+
+static void* walker_main(void* arg) {
+    struct walker_thread* t = arg;
+    struct walker* w = t->w;
+    struct dir_reader rd;
+    reader_init(&rd, w->fl);
+    struct name_arena subdirs = {0};
+
+    for (;;) {
+        struct dir_node* node = walker_take(w, t->self);
+        if (node) {
+            walk_node(w, t->self, node, &rd, &subdirs);
+            continue;
+        }
+        pthread_mutex_lock(&w->lock);
+        while (w->queued == 0 && w->pending > 0) {
+            pthread_cond_wait(&w->work_cv, &w->lock);
+        }
+        bool finished = w->pending == 0;
+        pthread_mutex_unlock(&w->lock);
+        if (finished) break;
+    }
+
+    arena_release(&subdirs);
+    reader_release(&rd);
+    id_cache_release(&uid_cache);
+    id_cache_release(&gid_cache);
+    return NULL;
+}
+
+// Вывод в порядке recursive_ls(); узлы освобождаются сразу после вывода.
+// Возвращает итог -s для поддерева.
+static uint64_t emit_node(struct walker* w, struct dir_node* node) {
+    pthread_mutex_lock(&w->lock);
+    while (!node->done) pthread_cond_wait(&w->done_cv, &w->lock);
+    pthread_mutex_unlock(&w->lock);
+
+    ob_write(&stdout_buf, node->out, node->out_len);
+    bool du = w->fl->du_flag;
+    uint64_t blocks = 0;
+    for (size_t i = 0; i < node->child_count; i++) {
+        print_header(&stdout_buf, node->children[i]->path, node->depth);
+        if (du) blocks += du_settle(&node->du, node->du.subdir_pos[i]);
+        blocks += emit_node(w, node->children[i]);
+    }
+    if (du) {
+        blocks += du_settle(&node->du, SIZE_MAX);
+        du_dir_release(&node->du);
+        print_du_line(blocks, node->path);
+    }
+
+    free(node->children);
+    free(node->out);
+    free(node->path);
+    free(node);
+    return blocks;
+}
+
+static void parallel_ls(const char* path, const struct flags* fl) {
+    struct walker w;
+    memset(&w, 0, sizeof(w));
+    pthread_mutex_init(&w.lock, NULL);
+    pthread_cond_init(&w.work_cv, NULL);
+    pthread_cond_init(&w.done_cv, NULL);
+    w.nthreads = fl->threads;
+    w.fl       = fl;
+    w.deques   = xmalloc(w.nthreads * sizeof(*w.deques));
+    memset(w.deques, 0, w.nthreads * sizeof(*w.deques));
+    for (int i = 0; i < w.nthreads; i++) pthread_mutex_init(&w.deques[i].lock, NULL);
+
+    struct dir_node* root = node_new(NULL, path, 0);
+    walker_push(&w, 0, root);
+
+    pthread_t* tids = xmalloc(w.nthreads * sizeof(*tids));
+    struct walker_thread* args = xmalloc(w.nthreads * sizeof(*args));
+    for (int i = 0; i < w.nthreads; i++) {
+        args[i].w = &w;
+        args[i].self = i;
+        int err = pthread_create(&tids[i], NULL, walker_main, &args[i]);
+        if (err) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(err));
+            exit(1);
+        }
+    }
+
+    emit_node(&w, root);
+    for (int i = 0; i < w.nthreads; i++) pthread_join(tids[i], NULL);
+
+    for (int i = 0; i < w.nthreads; i++) {
+        free(w.deques[i].items);
+        pthread_mutex_destroy(&w.deques[i].lock);
+    }
+    free(w.deques);
+    free(tids);
+    free(args);
+    pthread_cond_destroy(&w.done_cv);
+    pthread_cond_destroy(&w.work_cv);
+    pthread_mutex_destroy(&w.lock);
+}
+
+static void list(const struct flags* fl) {
+    if (fl->recursive_flag && fl->threads > 1) {
+        ob_puts(&stdout_buf, ".:\n");
+        parallel_ls(".", fl);
+        return;
+    }
+
+    struct dir_reader rd;
+    reader_init(&rd, fl);
+    if (!fl->recursive_flag) {
+        struct du_dir du = {0};
+        open_dir_and_print_list(&stdout_buf, ".", &rd, NULL, fl->du_flag ? &du : NULL, fl);
+        if (fl->du_flag) {
+            print_du_line(du_settle(&du, SIZE_MAX), ".");
+            du_dir_release(&du);
+        }
+    } else {
+        ob_puts(&stdout_buf, ".:\n");
+        recursive_ls(".", 0, &rd, fl);
+    }
+    reader_release(&rd);
+}
+
+static void run(const struct flags* fl) {
+    if (fl->du_flag) {
+        ob_init(&du_buf, -1);
+    }
+    if (use_snapshot(fl)) snap_init(fl);
+    if (fl->watch_flag) watch_init(fl);
+
+    list(fl);
+
+    if (use_snapshot(fl)) snap_finish(fl);
+
+    if (fl->du_flag) {
+        if (!fl->long_flag) ob_putc(&stdout_buf, '\n');
+        ob_write(&stdout_buf, du_buf.data, du_buf.len);
+        free(du_buf.data);
+        inode_set_release();
+    }
+
+    if (fl->watch_flag) watch_loop(fl);
 }
 
 int main(int argc, char* argv[]) {
     struct flags fl = {};
     flags_ctor(&fl);
     get_options(&fl, argc, argv);
+    ob_init(&stdout_buf, STDOUT_FILENO);
+    atexit(flush_stdout_buf);
     run(&fl);
     return EXIT_SUCCESS;
 }
\ No newline at end of file
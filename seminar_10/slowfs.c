@@ -0,0 +1,325 @@
+// Медленная файловая система для проверки myls -u: FUSE без libfuse,
+// протокол ядра напрямую через /dev/fuse. Дерево синтетическое — в корне
+// dirs подкаталогов и files файлов, в каждом подкаталоге ещё files
+// файлов. Каждый LOOKUP и GETATTR отвечается через delay микросекунд, как
+// поход к удалённому серверу; кэш атрибутов и имён в ядре выключен, так
+// что каждый stat доходит до нас. Запросы обслуживают threads потоков,
+// поэтому параллельные stat ждут одновременно.
+//
+//   ./slowfs -n 2000 -d 4 -l 2000 -t 32 /tmp/slow &
+//   ./myls -l ... ; umount /tmp/slow
+//
+// Монтирование требует root (или CAP_SYS_ADMIN в своём пространстве имён).
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <linux/fuse.h>
+
+#define READ_BUF_SIZE (FUSE_MIN_READ_BUFFER + 128 * 1024)
+#define BASE_MTIME    1700000000
+
+struct slowfs {
+    int      fd;
+    unsigned files;        // файлов в каждом каталоге
+    unsigned dirs;         // подкаталогов в корне
+    unsigned delay_us;     // задержка LOOKUP и GETATTR
+};
+
+static struct slowfs fs;
+
+// Номер узла: каталог d (0 — корень) — 1 + d * (files + 1), его файл j —
+// следующий за ним номер + j.
+static uint64_t dir_ino(unsigned d) {
+    return 1 + (uint64_t)d * (fs.files + 1);
+}
+
+static bool decode_ino(uint64_t ino, unsigned* d, long* j) {
+    *d = 0;
+    *j = -1;
+    if (ino < 1) return false;
+    uint64_t k = ino - 1;
+    *d = (unsigned)(k / (fs.files + 1));
+    *j = (long)(k % (fs.files + 1)) - 1;   // -1 — сам каталог
+    return *d <= fs.dirs;
+}
+
+static void fill_attr(uint64_t ino, struct fuse_attr* attr) {
+    unsigned d;
+    long j;
+    decode_ino(ino, &d, &j);
+    memset(attr, 0, sizeof(*attr));
+    attr->ino     = ino;
+    attr->blksize = 4096;
+    if (j < 0) {
+        attr->mode  = S_IFDIR | 0755;
+        attr->nlink = d == 0 ? 2 + fs.dirs : 2;
+        attr->size  = 4096;
+        attr->mtime = BASE_MTIME;
+    } else {
+        attr->mode  = S_IFREG | (j % 7 == 0 ? 0755 : 0644);
+        attr->nlink = 1;
+        attr->size  = (uint64_t)(j * 7919 % 100000);
+        attr->mtime = BASE_MTIME - (uint64_t)j * 60;
+    }
+    attr->atime  = attr->mtime;
+    attr->ctime  = attr->mtime;
+    attr->blocks = (attr->size + 511) / 512;
+}
+
+static void sleep_us(unsigned usec) {
+    if (!usec) return;
+    struct timespec ts = { usec / 1000000, (long)(usec % 1000000) * 1000 };
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {}
+}
+
+static void reply(uint64_t unique, int error, const void* data, size_t len) {
+    struct fuse_out_header hdr = {
+        .len    = (uint32_t)(sizeof(hdr) + (error ? 0 : len)),
+        .error  = -error,
+        .unique = unique,
+    };
+    struct iovec iov[2] = {
+        { &hdr, sizeof(hdr) },
+        { (void*)data, error ? 0 : len },
+    };
+    // ENOENT — запрос уже прерван, ответ не нужен.
+    if (writev(fs.fd, iov, 2) < 0 && errno != ENOENT) {
+        perror("writev(/dev/fuse)");
+    }
+}
+
+static void do_init(uint64_t unique, const struct fuse_init_in* in) {
+    struct fuse_init_out out;
+    memset(&out, 0, sizeof(out));
+    out.major = FUSE_KERNEL_VERSION;
+    out.minor = in->minor < FUSE_KERNEL_MINOR_VERSION ? in->minor : FUSE_KERNEL_MINOR_VERSION;
+    out.max_readahead = in->max_readahead;
+    out.max_background = 64;
+    out.congestion_threshold = 48;
+    out.max_write = 128 * 1024;
+    out.time_gran = 1;
+    reply(unique, 0, &out, sizeof(out));
+}
+
+static bool lookup_name(unsigned d, const char* name, uint64_t* ino) {
+    unsigned k;
+    char tail;
+    if (d == 0 && sscanf(name, "dir%u%c", &k, &tail) == 1 && k >= 1 && k <= fs.dirs) {
+        *ino = dir_ino(k);
+        return true;
+    }
+    if (sscanf(name, "file%u%c", &k, &tail) == 1 && k < fs.files) {
+        *ino = dir_ino(d) + 1 + k;
+        return true;
+    }
+    return false;
+}
+
+static void do_lookup(uint64_t unique, uint64_t parent, const char* name) {
+    sleep_us(fs.delay_us);
+    unsigned d;
+    long j;
+    uint64_t ino;
+    if (!decode_ino(parent, &d, &j) || j >= 0 || !lookup_name(d, name, &ino)) {
+        reply(unique, ENOENT, NULL, 0);
+        return;
+    }
+    struct fuse_entry_out out;
+    memset(&out, 0, sizeof(out));
+    out.nodeid     = ino;
+    out.generation = 1;
+    fill_attr(ino, &out.attr);      // entry_valid и attr_valid — 0: без кэша
+    reply(unique, 0, &out, sizeof(out));
+}
+
+static void do_getattr(uint64_t unique, uint64_t ino) {
+    sleep_us(fs.delay_us);
+    struct fuse_attr_out out;
+    memset(&out, 0, sizeof(out));
+    fill_attr(ino, &out.attr);
+    reply(unique, 0, &out, sizeof(out));
+}
+
+static size_t add_dirent(char* buf, size_t pos, size_t size, uint64_t ino, uint64_t off,
+                         unsigned type, const char* name) {
+    size_t namelen = strlen(name);
+    size_t reclen  = FUSE_DIRENT_ALIGN(FUSE_NAME_OFFSET + namelen);
+    if (pos + reclen > size) return 0;
+    struct fuse_dirent* de = (struct fuse_dirent*)(buf + pos);
+    memset(de, 0, reclen);
+    de->ino     = ino;
+    de->off     = off;
+    de->namelen = (uint32_t)namelen;
+    de->type    = type;
+    memcpy(de->name, name, namelen);
+    return reclen;
+}
+
+// Записи каталога по порядку: ".", "..", подкаталоги (только в корне),
+// файлы. Смещение записи — её номер + 1.
+static void do_readdir(uint64_t unique, uint64_t ino, const struct fuse_read_in* in) {
+    unsigned d;
+    long j;
+    decode_ino(ino, &d, &j);
+    size_t size = in->size < READ_BUF_SIZE ? in->size : READ_BUF_SIZE;
+    char* buf = malloc(size);
+    if (!buf) {
+        reply(unique, ENOMEM, NULL, 0);
+        return;
+    }
+
+    uint64_t subdirs = d == 0 ? fs.dirs : 0;
+    uint64_t total   = 2 + subdirs + fs.files;
+    size_t pos = 0;
+    for (uint64_t k = in->offset; k < total; k++) {
+        char name[32];
+        uint64_t e_ino;
+        unsigned type;
+        if (k < 2) {
+            snprintf(name, sizeof(name), k == 0 ? "." : "..");
+            e_ino = k == 0 ? dir_ino(d) : dir_ino(0);
+            type  = DT_DIR;
+        } else if (k < 2 + subdirs) {
+            snprintf(name, sizeof(name), "dir%03u", (unsigned)(k - 1));
+            e_ino = dir_ino((unsigned)(k - 1));
+            type  = DT_DIR;
+        } else {
+            unsigned f = (unsigned)(k - 2 - subdirs);
+            snprintf(name, sizeof(name), "file%06u", f);
+            e_ino = dir_ino(d) + 1 + f;
+            type  = DT_REG;
+        }
+        size_t len = add_dirent(buf, pos, size, e_ino, k + 1, type, name);
+        if (!len) break;
+        pos += len;
+    }
+    reply(unique, 0, buf, pos);
+    free(buf);
+}
+
+static void* serve(void* arg) {
+    (void)arg;
+    char* buf = malloc(READ_BUF_SIZE);
+    if (!buf) {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (;;) {
+        ssize_t n = read(fs.fd, buf, READ_BUF_SIZE);
+        if (n < 0) {
+            if (errno == EINTR || errno == ENOENT || errno == EAGAIN) continue;
+            if (errno == ENODEV) break;          // размонтировано
+            perror("read(/dev/fuse)");
+            exit(1);
+        }
+        if ((size_t)n < sizeof(struct fuse_in_header)) continue;
+
+        const struct fuse_in_header* in = (const struct fuse_in_header*)buf;
+        const void* arg_in = buf + sizeof(*in);
+        switch (in->opcode) {
+            case FUSE_INIT:       do_init(in->unique, arg_in); break;
+            case FUSE_LOOKUP:     do_lookup(in->unique, in->nodeid, arg_in); break;
+            case FUSE_GETATTR:    do_getattr(in->unique, in->nodeid); break;
+            case FUSE_READDIR:    do_readdir(in->unique, in->nodeid, arg_in); break;
+            case FUSE_OPENDIR: {
+                struct fuse_open_out out;
+                memset(&out, 0, sizeof(out));
+                reply(in->unique, 0, &out, sizeof(out));
+                break;
+            }
+            case FUSE_RELEASEDIR: reply(in->unique, 0, NULL, 0); break;
+            case FUSE_STATFS: {
+                struct fuse_statfs_out out;
+                memset(&out, 0, sizeof(out));
+                out.st.bsize   = 4096;
+                out.st.namelen = 255;
+                reply(in->unique, 0, &out, sizeof(out));
+                break;
+            }
+            case FUSE_FORGET:
+            case FUSE_BATCH_FORGET:
+            case FUSE_INTERRUPT:
+                break;                          // без ответа
+            case FUSE_DESTROY:
+                reply(in->unique, 0, NULL, 0);
+                exit(0);
+            default:
+                reply(in->unique, ENOSYS, NULL, 0);
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "usage: %s [-n files] [-d dirs] [-l delay_us] [-t threads] mountpoint\n"
+            "  -n  files in every directory (default 1000)\n"
+            "  -d  subdirectories of the root (default 0)\n"
+            "  -l  delay of every LOOKUP and GETATTR, microseconds (default 1000)\n"
+            "  -t  threads serving requests (default 16)\n",
+            prog);
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    fs.files    = 1000;
+    fs.dirs     = 0;
+    fs.delay_us = 1000;
+    int threads = 16;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:d:l:t:")) != -1) {
+        switch (opt) {
+            case 'n': fs.files    = (unsigned)atoi(optarg); break;
+            case 'd': fs.dirs     = (unsigned)atoi(optarg); break;
+            case 'l': fs.delay_us = (unsigned)atoi(optarg); break;
+            case 't': threads     = atoi(optarg); break;
+            default:  usage(argv[0]);
+        }
+    }
+    if (optind + 1 != argc || threads < 1 || fs.dirs > 999) usage(argv[0]);
+    const char* mountpoint = argv[optind];
+
+    fs.fd = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+    if (fs.fd < 0) {
+        perror("open(/dev/fuse)");
+        exit(1);
+    }
+    char opts[128];
+    snprintf(opts, sizeof(opts), "fd=%d,rootmode=40755,user_id=%u,group_id=%u,allow_other",
+             fs.fd, (unsigned)getuid(), (unsigned)getgid());
+    if (mount("slowfs", mountpoint, "fuse.slowfs", MS_NOSUID | MS_NODEV | MS_RDONLY, opts) != 0) {
+        perror("mount");
+        exit(1);
+    }
+
+    pthread_t* tids = malloc(threads * sizeof(*tids));
+    if (!tids) {
+        perror("malloc");
+        exit(1);
+    }
+    for (int i = 0; i < threads; i++) {
+        int err = pthread_create(&tids[i], NULL, serve, NULL);
+        if (err) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(err));
+            exit(1);
+        }
+    }
+    for (int i = 0; i < threads; i++) pthread_join(tids[i], NULL);
+    free(tids);
+    return 0;
+}
@@ -0,0 +1,41 @@
+#!/bin/sh
+# Стресс-тест разбора myshell: строки по 100k аргументов и длинные конвейеры.
+# Собирает шелл с -DDEBUG и проверяет, что арена перестаёт расти после
+# первой строки (сообщения "arena: ..." выводятся только при malloc).
+#
+#   ./bench_myshell_args.sh [lines] [args-per-line]
+
+set -eu
+
+LINES=${1:-200}
+ARGS=${2:-100000}
+DIR=$(cd "$(dirname "$0")" && pwd)
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+cc -std=gnu11 -O2 -DDEBUG -o "$TMP/myshell" "$DIR/myshell.c"
+
+# Одна строка: true a0 a1 ... | true ... | ... (100 стадий)
+awk -v n="$ARGS" 'BEGIN {
+    printf "true";
+    for (i = 0; i < n; ++i) printf " a%d", i;
+    for (i = 0; i < 100; ++i) printf " | true";
+    printf "\n";
+}' > "$TMP/line"
+
+: > "$TMP/script"
+i=0
+while [ "$i" -lt "$LINES" ]; do
+    cat "$TMP/line" >> "$TMP/script"
+    i=$((i + 1))
+done
+
+echo "script: $LINES lines x $ARGS args, $(wc -c < "$TMP/script") bytes"
+
+start=$(date +%s.%N)
+"$TMP/myshell" "$TMP/script" 2> "$TMP/err"
+end=$(date +%s.%N)
+
+awk -v s="$start" -v e="$end" 'BEGIN { printf "elapsed: %.3f s\n", e - s }'
+echo "arena mallocs: $(grep -c 'arena:' "$TMP/err" || true) (expected: only for the first line)"
+grep -v 'arena:' "$TMP/err" || true
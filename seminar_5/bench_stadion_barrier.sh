@@ -0,0 +1,25 @@
+#!/bin/sh
+# Масштабирование старта эстафеты: check-in через очередь SysV против
+# комбинирующего дерева (-b) для N от 10 до 100k бегунов.
+#
+#   ./bench_stadion_barrier.sh [process|thread] [fan-in]
+#
+# Для больших N нужны достаточные pid_max / RLIMIT_NPROC.
+# Список N можно переопределить: SIZES="10 1000" ./bench_stadion_barrier.sh
+
+set -eu
+
+MODE=${1:-process}
+FANIN=${2:-8}
+DIR=$(cd "$(dirname "$0")" && pwd)
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+c++ -std=c++17 -O2 -pthread -o "$TMP/stadion" "$DIR/stadion.cpp"
+
+printf "%8s  %-40s  %s\n" "N" "queue check-in (sysv)" "combining tree, fan-in $FANIN"
+for n in ${SIZES:-10 100 1000 10000 100000}; do
+    q=$("$TMP/stadion" -q -m "$MODE" "$n" | grep '^start-up' || echo "start-up: failed")
+    t=$("$TMP/stadion" -q -m "$MODE" -b "$FANIN" "$n" | grep '^start-up' || echo "start-up: failed")
+    printf "%8s  %-40s  %s\n" "$n" "${q#start-up: }" "${t#start-up: }"
+done
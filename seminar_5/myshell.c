@@ -1,18 +1,36 @@
+#define _GNU_SOURCE
 #include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/signalfd.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+// #define DEBUG
+
+#ifdef DEBUG
+    #define ON_DEBUG(...) __VA_ARGS__
+#else
+    #define ON_DEBUG(...)
+#endif
+
 // --------------------------- Константы и настройки ---------------------------
 #define GREEN "\033[1;32m"                  // esc (зеленый)
 #define RESET "\033[0m"                     // esc (завершение)
-#define SHELL_LINE_CAP   1024               // Максимальная длина вводимой строки
-#define SHELL_ARG_MAX    64                 // Максимум аргументов в одной команде
-#define SHELL_PIPE_MAX   16                 // Максимум команд в конвейере
+#define SHELL_ARENA_MIN  (64 * 1024)        // Начальный размер арены разбора
+#define SHELL_JOBS_MAX   64                 // Максимум одновременных фоновых заданий
 #define SHELL_PROMPT     GREEN "$ " RESET   // Приглашение
 
 // ------------------------------ Коды ошибок ---------------------------------
@@ -22,12 +40,87 @@ typedef enum {
     SH_ERR_SYNTAX,
     SH_ERR_OPEN,
     SH_ERR_PIPE,
-    SH_ERR_ARGV_LIMIT,
     SH_ERR_EXEC,
-    SH_ERR_PIPELEN_LIMIT,
-    SH_ERR_INPUT_READ
+    SH_ERR_INPUT_READ,
+    SH_ERR_SIGNAL,
+    SH_ERR_NOMEM
 } sh_status_t;
 
+// ---------------------------------- Арена -----------------------------------
+
+// Всё, что относится к разбору одной строки (argv, список стадий, pid'ы),
+// берётся из bump-арены и освобождается разом после выполнения команды.
+// Если строка не поместилась, к арене цепляется блок вдвое больше;
+// при сбросе цепочка сливается в один блок суммарного размера, так что
+// в установившемся режиме разбор обходится без malloc.
+typedef struct sh_arena_block {
+    struct sh_arena_block *prev;
+    size_t                 cap;
+    size_t                 used;
+    max_align_t            data[];
+} sh_arena_block_t;
+
+typedef struct {
+    sh_arena_block_t *head;
+    size_t            total;        // суммарная ёмкость всех блоков
+} sh_arena_t;
+
+// ------------------------------ Фоновые задания ------------------------------
+
+// Задание — один конвейер, запущенный с '&'. Номер задания = индекс слота + 1.
+typedef struct {
+    bool    used;
+    pid_t  *pids;
+    size_t  count;                  // сколько процессов в конвейере
+    size_t  alive;                  // сколько из них ещё не завершилось
+    char   *cmd;                    // исходный текст команды (для сообщений)
+} sh_job_t;
+
+// Разобранная строка: конвейер и его атрибуты.
+typedef struct {
+    char      **segments;
+    size_t      seg_count;
+    const char *in_path;
+    const char *out_path;
+    const char *cmd;                // исходный текст команды
+    bool        background;         // завершающий '&'
+    bool        timed;              // префикс `time`
+} sh_pipeline_t;
+
+// Статистика одной стадии конвейера для `time`.
+typedef struct {
+    const char      *name;
+    struct timespec  started;
+    struct timespec  finished;
+    struct rusage    usage;
+    long long        rchar, wchar;              // байты через read()/write()
+    long long        read_bytes, write_bytes;   // байты с/на устройство
+} sh_stage_stats_t;
+
+// Стадия конвейера, выполняемая потоком внутри шелла (cat, wc, head, tee)
+// вместо fork+exec. Поток владеет своими in_fd/out_fd и закрывает их сам,
+// чтобы соседние стадии увидели EOF/EPIPE.
+typedef struct sh_thread_stage {
+    pthread_t         tid;
+    char            **argv;
+    int               in_fd;
+    int               out_fd;
+    sh_stage_stats_t *stats;        // NULL, если конвейер без `time`
+    int             (*run)(struct sh_thread_stage *st);
+} sh_thread_stage_t;
+
+typedef struct {
+    const char *name;
+    bool      (*accepts)(char **argv);  // false — опции не поддержаны, нужен exec
+    int       (*run)(sh_thread_stage_t *st);
+} sh_builtin_stage_t;
+
+static sh_job_t  jobs[SHELL_JOBS_MAX];
+static int       sigchld_fd = -1;   // signalfd, на который приходит SIGCHLD
+static sigset_t  orig_sigmask;      // маска сигналов до блокировки SIGCHLD
+static bool      interactive = true;
+static sh_arena_t arena;            // арена разбора текущей строки
+
 // -------------------------- Вспомогательные макросы -------------------------
 
 #define UNUSED(x) (void)(x)
@@ -45,96 +138,247 @@ static void         extract_redirections(char *segment,
                                          const char **in_path,
                                          const char **out_path);
 
-static sh_status_t  run_pipeline(char **segments,
-                                 size_t seg_count,
-                                 const char *in_path,
-                                 const char *out_path);
+static sh_status_t  run_pipeline(const sh_pipeline_t *pl);
+
+static void         wait_pipeline_timed(const pid_t *pids,
+                                        sh_stage_stats_t *stats,
+                                        size_t spawned);
+
+static void         print_stage_table(const sh_stage_stats_t *stats, size_t spawned);
+
+static const sh_builtin_stage_t *find_builtin_stage(char **argv);
+static void        *thread_stage_main(void *arg);
 
-static sh_status_t  tokenize_command(char *segment, char **argv);
+static sh_status_t  tokenize_command(char *segment, char ***argv);
+
+static void        *arena_alloc(sh_arena_t *a, size_t size);
+static void         arena_reset(sh_arena_t *a);
+static void         arena_free(sh_arena_t *a);
+
+static sh_status_t  execute_line(char *line, bool *want_exit);
+
+static sh_status_t  jobs_init(void);
+static void         jobs_reap(void);
+static void         job_account(pid_t pid);
+static void         jobs_block(void);
+static size_t       jobs_active(void);
+static sh_status_t  builtin_wait(char **argv);
+static sh_status_t  builtin_parallel(char **argv);
 
 // --------------------------------- main -------------------------------------
 
+// Без аргументов — интерактивный режим (приглашение печатается, только если
+// stdin — терминал). С одним аргументом — выполнение команд из файла-скрипта.
 int main(int argc, const char *argv[]) {
-    UNUSED(argc); UNUSED(argv);
+    if (argc > 2) {
+        fprintf(stderr, "Usage: %s [script]\n", argv[0]);
+        return (int)SH_ERR_SYNTAX;
+    }
+
+    FILE *input = stdin;
+    if (argc == 2) {
+        input = fopen(argv[1], "r");
+        if (!input) {
+            perror(argv[1]);
+            return (int)SH_ERR_OPEN;
+        }
+    }
+    interactive = (input == stdin) && isatty(STDIN_FILENO);
 
-    char   line[SHELL_LINE_CAP];
-    char  *segments[SHELL_PIPE_MAX];
+    sh_status_t st = jobs_init();
+    if (st != SH_OK) {
+        return (int)st;
+    }
+
+    // Встроенные стадии пишут в каналы из потоков шелла: ушедший читатель
+    // должен давать им EPIPE, а не убивать весь шелл.
+    signal(SIGPIPE, SIG_IGN);
+
+    char   *line     = NULL;
+    size_t  line_cap = 0;
 
     for (;;) {
-        fputs(SHELL_PROMPT, stdout);
-        fflush(stdout);
+        jobs_reap();
+
+        if (interactive) {
+            fputs(SHELL_PROMPT, stdout);
+            fflush(stdout);
 
-        if (!fgets(line, sizeof line, stdin)) {
-            return (int)SH_ERR_INPUT_READ;
+            // Пока пользователь ничего не ввёл, продолжаем собирать
+            // завершившиеся фоновые задания.
+            struct pollfd pfd[2] = {
+                { .fd = STDIN_FILENO, .events = POLLIN },
+                { .fd = sigchld_fd,   .events = POLLIN },
+            };
+            while (poll(pfd, 2, -1) >= 0 && !(pfd[0].revents & (POLLIN | POLLHUP))) {
+                jobs_reap();
+            }
+        }
+
+        if (getline(&line, &line_cap, input) < 0) {
+            if (interactive || ferror(input)) {
+                return (int)SH_ERR_INPUT_READ;
+            }
+            break;
         }
 
         line[strcspn(line, "\n")] = '\0';
-        if (line[0] == '\0') {
+        if (line[0] == '\0' || line[0] == '#') {
             continue;
         }
 
-        if (strcmp(line, "exit") == 0) {
+        bool want_exit = false;
+        st = execute_line(line, &want_exit);
+        arena_reset(&arena);
+        if (st != SH_OK) {
+            return (int)st;
+        }
+        if (want_exit) {
             break;
         }
+    }
 
-        size_t seg_count = 0;
-        char  *scan      = line;
-        segments[seg_count++] = scan; 
+    while (jobs_active() > 0) {
+        jobs_block();
+    }
 
-        while (*scan) {
-            if (*scan == '|') {
-                *scan = '\0'; 
-                if (seg_count >= SHELL_PIPE_MAX) {
-                    fprintf(stderr,
-                            "Sorry, this shell supports only %d commands in conveyor.\n",
-                            SHELL_PIPE_MAX);
-                    return (int)SH_ERR_PIPELEN_LIMIT;
-                }
-                segments[seg_count++] = scan + 1;
-            }
-            ++scan;
+    free(line);
+    arena_free(&arena);
+    if (input != stdin) {
+        fclose(input);
+    }
+    return EXIT_SUCCESS;
+}
+
+static sh_status_t execute_line(char *line, bool *want_exit) {
+    sh_pipeline_t pl = {0};
+
+    // Завершающий '&' отправляет конвейер в фон.
+    size_t len        = strlen(line);
+    while (len > 0 && isspace((unsigned char)line[len - 1])) {
+        line[--len] = '\0';
+    }
+    if (len > 0 && line[len - 1] == '&') {
+        line[--len] = '\0';
+        pl.background = true;
+        while (len > 0 && isspace((unsigned char)line[len - 1])) {
+            line[--len] = '\0';
         }
+        if (len == 0) {
+            fprintf(stderr, "Syntax error near '&'.\n");
+            return SH_ERR_SYNTAX;
+        }
+    }
 
-        const char *in_path  = NULL;
-        const char *out_path = NULL;
+    const char *word     = line + strspn(line, " \t");
+    size_t      word_len = strcspn(word, " \t");
 
-        for (size_t i = 0; i < seg_count; ++i) {
-            const char *in  = NULL;
-            const char *out = NULL;
-            extract_redirections(segments[i], &in, &out);
+    // `time cmd | cmd ...` — посчитать ресурсы каждой стадии.
+    if (word_len == 4 && strncmp(word, "time", 4) == 0) {
+        if (pl.background) {
+            fprintf(stderr, "time: background pipelines are not supported.\n");
+            return SH_ERR_SYNTAX;
+        }
+        pl.timed = true;
+        line     = (char *)word + word_len;
+        word     = line + strspn(line, " \t");
+        word_len = strcspn(word, " \t");
+        if (word_len == 0) {
+            fprintf(stderr, "time: missing command.\n");
+            return SH_ERR_SYNTAX;
+        }
+    }
 
-            if (in) {
-                if (i != 0) {
-                    fprintf(stderr, "Only first command can have input redirection.\n");
-                    return (int)SH_ERR_SYNTAX;
-                }
-                if (in_path) {
-                    fprintf(stderr, "Only one input redirection is allowed.\n");
-                    return (int)SH_ERR_SYNTAX;
-                }
-                in_path = in;
-            }
+    if (word_len == 4 && strncmp(word, "exit", 4) == 0) {
+        *want_exit = true;
+        return SH_OK;
+    }
 
-            if (out) {
-                if (i + 1 != seg_count) {
-                    fprintf(stderr, "Only last command can have output redirection.\n");
-                    return (int)SH_ERR_SYNTAX;
-                }
-                if (out_path) {
-                    fprintf(stderr, "Only one output redirection is allowed.\n");
-                    return (int)SH_ERR_SYNTAX;
-                }
-                out_path = out;
+    if (word_len == 4 && strncmp(word, "wait", 4) == 0) {
+        char **argv = NULL;
+        sh_status_t tok = tokenize_command(line, &argv);
+        return tok != SH_OK ? tok : builtin_wait(argv);
+    }
+
+    if (word_len == 8 && strncmp(word, "parallel", 8) == 0) {
+        if (pl.background || pl.timed || strchr(word, '|')) {
+            fprintf(stderr, "parallel: cannot be used with '&', 'time' or '|'.\n");
+            return SH_ERR_SYNTAX;
+        }
+        char **argv = NULL;
+        sh_status_t tok = tokenize_command(line, &argv);
+        return tok != SH_OK ? tok : builtin_parallel(argv);
+    }
+
+    size_t cmd_len = strlen(word);
+    char  *cmd     = arena_alloc(&arena, cmd_len + 1);
+    if (!cmd) {
+        return SH_ERR_NOMEM;
+    }
+    memcpy(cmd, word, cmd_len + 1);
+    pl.cmd = cmd;
+
+    size_t max_segments = 1;
+    for (const char *c = line; *c; ++c) {
+        max_segments += (*c == '|');
+    }
+
+    char **segments  = arena_alloc(&arena, max_segments * sizeof *segments);
+    size_t seg_count = 0;
+    char  *scan      = line;
+    if (!segments) {
+        return SH_ERR_NOMEM;
+    }
+    segments[seg_count++] = scan; 
+
+    while (*scan) {
+        if (*scan == '|') {
+            *scan = '\0'; 
+            segments[seg_count++] = scan + 1;
+        }
+        ++scan;
+    }
+
+    pl.segments = segments;
+    pl.seg_count = seg_count;
+
+    const char *in_path  = NULL;
+    const char *out_path = NULL;
+
+    for (size_t i = 0; i < seg_count; ++i) {
+        const char *in  = NULL;
+        const char *out = NULL;
+        extract_redirections(segments[i], &in, &out);
+
+        if (in) {
+            if (i != 0) {
+                fprintf(stderr, "Only first command can have input redirection.\n");
+                return SH_ERR_SYNTAX;
             }
+            if (in_path) {
+                fprintf(stderr, "Only one input redirection is allowed.\n");
+                return SH_ERR_SYNTAX;
+            }
+            in_path = in;
         }
 
-        sh_status_t st = run_pipeline(segments, seg_count, in_path, out_path);
-        if (st != SH_OK) {
-            return (int)st; 
+        if (out) {
+            if (i + 1 != seg_count) {
+                fprintf(stderr, "Only last command can have output redirection.\n");
+                return SH_ERR_SYNTAX;
+            }
+            if (out_path) {
+                fprintf(stderr, "Only one output redirection is allowed.\n");
+                return SH_ERR_SYNTAX;
+            }
+            out_path = out;
         }
     }
 
-    return EXIT_SUCCESS;
+    pl.in_path  = in_path;
+    pl.out_path = out_path;
+
+    return run_pipeline(&pl);
 }
 
 static void extract_redirections(char *segment,
@@ -181,31 +425,117 @@ static void extract_redirections(char *segment,
     }
 }
 
-static sh_status_t run_pipeline(char **segments,
-                                size_t seg_count,
-                                const char *in_path,
-                                const char *out_path) {
+static sh_status_t run_pipeline(const sh_pipeline_t *pl) {
+    char *const *segments  = pl->segments;
+    size_t       seg_count = pl->seg_count;
+    const char  *in_path   = pl->in_path;
+    const char  *out_path  = pl->out_path;
+    bool         background = pl->background;
+
     int    prev_read_fd  = -1;  
     int    pipe_fds[2]   = {-1, -1};
     size_t spawned       = 0;
+    sh_status_t st       = SH_OK;
+    bool   redirect_failed = false;
+
+    // pids[k] == 0 — стадия k выполняется потоком threads[k].
+    pid_t             *pids    = arena_alloc(&arena, seg_count * sizeof *pids);
+    sh_thread_stage_t *threads = arena_alloc(&arena, seg_count * sizeof *threads);
+    sh_stage_stats_t  *stats   = pl->timed ? arena_alloc(&arena, seg_count * sizeof *stats) : NULL;
+    if (!pids || !threads || (pl->timed && !stats)) {
+        return SH_ERR_NOMEM;
+    }
+
+    // Таблица заданий заполнена — ждём, пока освободится слот.
+    while (background && jobs_active() == SHELL_JOBS_MAX) {
+        jobs_block();
+    }
 
     for (size_t i = 0; i < seg_count; ++i) {
-        char *argv[SHELL_ARG_MAX];
-        sh_status_t tok = tokenize_command(segments[i], argv);
-        if (tok != SH_OK) {
-            close_if_open(&prev_read_fd);
-            return tok;
+        char **argv = NULL;
+        st = tokenize_command(segments[i], &argv);
+        if (st != SH_OK) {
+            break;
         }
 
+        // O_CLOEXEC: концы каналов, принадлежащие потокам-стадиям, не должны
+        // утечь в запускаемые позже программы, иначе те не увидят EOF.
         if (i + 1 != seg_count) {
-            if (pipe(pipe_fds) != 0) {
+            if (pipe2(pipe_fds, O_CLOEXEC) != 0) {
                 perror("Pipe error");
-                return SH_ERR_PIPE;
+                st = SH_ERR_PIPE;
+                break;
+            }
+        }
+
+        if (pl->timed) {
+            memset(&stats[spawned], 0, sizeof stats[spawned]);
+            stats[spawned].name = argv[0] ? argv[0] : "";
+            clock_gettime(CLOCK_MONOTONIC, &stats[spawned].started);
+        }
+
+        // Фоновые задания учитываются по pid, поэтому там всегда exec.
+        const sh_builtin_stage_t *builtin = background ? NULL : find_builtin_stage(argv);
+        if (builtin) {
+            sh_thread_stage_t *ts = &threads[spawned];
+            ts->argv   = argv;
+            ts->run    = builtin->run;
+            ts->stats  = pl->timed ? &stats[spawned] : NULL;
+            ts->in_fd  = prev_read_fd >= 0 ? prev_read_fd : STDIN_FILENO;
+            ts->out_fd = i + 1 != seg_count ? pipe_fds[1] : STDOUT_FILENO;
+
+            if (i == 0 && in_path) {
+                ts->in_fd = open(in_path, O_RDONLY | O_CLOEXEC);
+            }
+            if (i + 1 == seg_count && out_path) {
+                ts->out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0664);
+            }
+            if (ts->in_fd < 0 || ts->out_fd < 0) {
+                perror(ts->in_fd < 0 ? in_path : out_path);
+                if (ts->in_fd != STDIN_FILENO) {
+                    close_if_open(&ts->in_fd);
+                }
+                if (ts->out_fd != STDOUT_FILENO) {
+                    close_if_open(&ts->out_fd);
+                }
+                prev_read_fd = pipe_fds[1] = -1;
+                close_if_open(&pipe_fds[0]);
+                // Как у стадии-процесса с _exit(SH_ERR_OPEN): ошибка
+                // только этого конвейера, шелл продолжает работу.
+                redirect_failed = true;
+                break;
             }
+
+            int err = pthread_create(&ts->tid, NULL, thread_stage_main, ts);
+            if (err != 0) {
+                fprintf(stderr, "pthread_create: %s\n", strerror(err));
+                if (ts->in_fd != STDIN_FILENO) {
+                    close(ts->in_fd);
+                }
+                if (ts->out_fd != STDOUT_FILENO) {
+                    close(ts->out_fd);
+                }
+                prev_read_fd = pipe_fds[1] = -1;
+                close_if_open(&pipe_fds[0]);
+                st = SH_ERR_EXEC;
+                break;
+            }
+
+            // Дескрипторы теперь принадлежат потоку.
+            pids[spawned++] = 0;
+            prev_read_fd    = -1;
+            if (i + 1 != seg_count) {
+                prev_read_fd = pipe_fds[0];
+                pipe_fds[0]  = pipe_fds[1] = -1;
+            }
+            continue;
         }
 
         pid_t pid = fork();
         if (pid == 0) { 
+            sigprocmask(SIG_SETMASK, &orig_sigmask, NULL);
+            signal(SIGPIPE, SIG_DFL);
+
             if (i == 0 && in_path) {
                 int fd_in = open(in_path, O_RDONLY);
                 if (fd_in < 0) {
@@ -249,10 +579,11 @@ static sh_status_t run_pipeline(char **segments,
                 close_if_open(&pipe_fds[0]);
                 close_if_open(&pipe_fds[1]);
             }
-            return SH_ERR_EXEC; 
+            st = SH_ERR_EXEC; 
+            break;
         }
 
-        ++spawned;
+        pids[spawned++] = pid;
 
         if (prev_read_fd >= 0) {
             close(prev_read_fd);
@@ -265,24 +596,530 @@ static sh_status_t run_pipeline(char **segments,
         }
     }
 
+    // При ошибке посередине уже запущенные стадии всё равно дожидаемся:
+    // потоки ссылаются на арену, которую сбросят после возврата.
+    close_if_open(&prev_read_fd);
+
+    if (background && st == SH_OK) {
+        for (size_t slot = 0; slot < SHELL_JOBS_MAX; ++slot) {
+            sh_job_t *job = &jobs[slot];
+            if (job->used) {
+                continue;
+            }
+            // Задание переживает строку, поэтому его данные — вне арены.
+            job->used  = true;
+            job->count = job->alive = spawned;
+            job->cmd   = strdup(pl->cmd);
+            job->pids  = malloc(spawned * sizeof pids[0]);
+            if (!job->pids) {
+                free(job->cmd);
+                job->used = false;
+                return SH_ERR_NOMEM;
+            }
+            memcpy(job->pids, pids, spawned * sizeof pids[0]);
+            if (interactive) {
+                printf("[%zu] %ld\n", slot + 1, (long)pids[spawned - 1]);
+            }
+            break;
+        }
+        return SH_OK;
+    }
+
+    if (pl->timed && st == SH_OK && !redirect_failed) {
+        wait_pipeline_timed(pids, stats, spawned);
+    } else {
+        for (size_t n = 0; n < spawned; ++n) {
+            if (pids[n] > 0) {
+                (void)waitpid(pids[n], NULL, 0);
+            }
+        }
+    }
+
     for (size_t n = 0; n < spawned; ++n) {
-        (void)wait(NULL);
+        if (pids[n] == 0) {
+            pthread_join(threads[n].tid, NULL);
+        }
     }
 
-    return SH_OK;
+    if (pl->timed && st == SH_OK && !redirect_failed) {
+        print_stage_table(stats, spawned);
+    }
+
+    return st;
+}
+
+// ----------------------------------- time ------------------------------------
+
+static double ts_ms(const struct timespec *t) {
+    return (double)t->tv_sec * 1.0e3 + (double)t->tv_nsec / 1.0e6;
+}
+
+static double tv_ms(const struct timeval *t) {
+    return (double)t->tv_sec * 1.0e3 + (double)t->tv_usec / 1.0e3;
+}
+
+// Счётчики ввода-вывода из /proc/<pid>/io (или /proc/thread-self/io для
+// потока-стадии). Для процесса читаются, пока он зомби: после wait4()
+// запись в /proc исчезает.
+static void read_proc_io(const char *path, sh_stage_stats_t *st) {
+    st->rchar = st->wchar = st->read_bytes = st->write_bytes = -1;
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return;
+    }
+
+    char      key[32];
+    long long val;
+    while (fscanf(f, "%31[^:]: %lld ", key, &val) == 2) {
+        if      (strcmp(key, "rchar")       == 0) st->rchar       = val;
+        else if (strcmp(key, "wchar")       == 0) st->wchar       = val;
+        else if (strcmp(key, "read_bytes")  == 0) st->read_bytes  = val;
+        else if (strcmp(key, "write_bytes") == 0) st->write_bytes = val;
+    }
+    fclose(f);
+}
+
+static void print_stage_row(const char *label, const char *name, double wall,
+                            const struct rusage *ru, const sh_stage_stats_t *st) {
+    fprintf(stderr, "%-5s %-12.12s %10.3f %9.3f %9.3f %9ld %7ld %7ld",
+            label, name, wall, tv_ms(&ru->ru_utime), tv_ms(&ru->ru_stime),
+            ru->ru_maxrss, ru->ru_nvcsw, ru->ru_nivcsw);
+    if (st) {
+        fprintf(stderr, " %12lld %12lld %12lld %12lld\n",
+                st->rchar, st->wchar, st->read_bytes, st->write_bytes);
+    } else {
+        fputc('\n', stderr);
+    }
+}
+
+// Ждёт стадии конвейера в порядке их фактического завершения.
+// waitid(WNOWAIT) оставляет процесс зомби, чтобы успеть прочитать
+// /proc/<pid>/io, а wait4() затем забирает его вместе с rusage.
+static void wait_pipeline_timed(const pid_t *pids,
+                                sh_stage_stats_t *stats,
+                                size_t spawned) {
+    size_t left = 0;
+    for (size_t k = 0; k < spawned; ++k) {
+        left += pids[k] > 0;
+    }
+
+    while (left > 0) {
+        siginfo_t info;
+        memset(&info, 0, sizeof info);
+        if (waitid(P_ALL, 0, &info, WEXITED | WNOWAIT) != 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("waitid");
+            return;
+        }
+
+        pid_t  pid = info.si_pid;
+        size_t k   = 0;
+        while (k < spawned && (pids[k] == 0 || pids[k] != pid)) {
+            ++k;
+        }
+
+        // Попался завершившийся фоновый процесс — просто учитываем его.
+        if (k == spawned) {
+            (void)waitpid(pid, NULL, 0);
+            job_account(pid);
+            continue;
+        }
+
+        char path[64];
+        snprintf(path, sizeof path, "/proc/%ld/io", (long)pid);
+
+        clock_gettime(CLOCK_MONOTONIC, &stats[k].finished);
+        read_proc_io(path, &stats[k]);
+        (void)wait4(pid, NULL, 0, &stats[k].usage);
+        --left;
+    }
+}
+
+static void print_stage_table(const sh_stage_stats_t *stats, size_t spawned) {
+    if (spawned == 0) {
+        return;
+    }
+
+    fprintf(stderr, "%-5s %-12s %10s %9s %9s %9s %7s %7s %12s %12s %12s %12s\n",
+            "stage", "command", "wall,ms", "user,ms", "sys,ms", "maxrss,KB",
+            "nvcsw", "nivcsw", "rchar", "wchar", "read_bytes", "write_bytes");
+
+    struct rusage total = {0};
+    double first = ts_ms(&stats[0].started);
+    double last  = first;
+
+    for (size_t k = 0; k < spawned; ++k) {
+        const struct rusage *ru = &stats[k].usage;
+        char label[24];
+        snprintf(label, sizeof label, "%zu", k);
+        print_stage_row(label, stats[k].name,
+                        ts_ms(&stats[k].finished) - ts_ms(&stats[k].started), ru, &stats[k]);
+
+        timeradd(&total.ru_utime, &ru->ru_utime, &total.ru_utime);
+        timeradd(&total.ru_stime, &ru->ru_stime, &total.ru_stime);
+        if (ru->ru_maxrss > total.ru_maxrss) {
+            total.ru_maxrss = ru->ru_maxrss;
+        }
+        total.ru_nvcsw  += ru->ru_nvcsw;
+        total.ru_nivcsw += ru->ru_nivcsw;
+
+        if (ts_ms(&stats[k].finished) > last) {
+            last = ts_ms(&stats[k].finished);
+        }
+    }
+
+    print_stage_row("total", "", last - first, &total, NULL);
+}
+
+// ---------------------------- Встроенные стадии -----------------------------
+
+#define STAGE_BUF_SIZE (64 * 1024)
+
+static bool write_all(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t m = write(fd, data, size);
+        if (m < 0 && errno == EINTR) {
+            continue;
+        }
+        if (m <= 0) {
+            return false;
+        }
+        data += m;
+        size -= (size_t)m;
+    }
+    return true;
+}
+
+static ssize_t read_some(int fd, char *buf, size_t size) {
+    ssize_t n;
+    while ((n = read(fd, buf, size)) < 0 && errno == EINTR) {
+    }
+    return n;
+}
+
+// Открывает аргумент-файл стадии; "-" означает вход стадии.
+static int stage_open(sh_thread_stage_t *st, const char *path) {
+    if (strcmp(path, "-") == 0) {
+        return st->in_fd;
+    }
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s: %s\n", st->argv[0], path, strerror(errno));
+    }
+    return fd;
+}
+
+static void stage_close(sh_thread_stage_t *st, int fd) {
+    if (fd != st->in_fd) {
+        close(fd);
+    }
+}
+
+// Нет опций, кроме "-" (стандартный вход).
+static bool accepts_files_only(char **argv) {
+    for (size_t i = 1; argv[i]; ++i) {
+        if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int cat_run(sh_thread_stage_t *st) {
+    char buf[STAGE_BUF_SIZE];
+    int  rc = 0;
+
+    char *stdin_only[] = { "-", NULL };
+    char **files = st->argv[1] ? st->argv + 1 : stdin_only;
+
+    for (size_t i = 0; files[i]; ++i) {
+        int fd = stage_open(st, files[i]);
+        if (fd < 0) {
+            rc = 1;
+            continue;
+        }
+
+        ssize_t n;
+        while ((n = read_some(fd, buf, sizeof buf)) > 0) {
+            if (!write_all(st->out_fd, buf, (size_t)n)) {
+                stage_close(st, fd);
+                return 1;
+            }
+        }
+        if (n < 0) {
+            fprintf(stderr, "cat: %s: %s\n", files[i], strerror(errno));
+            rc = 1;
+        }
+        stage_close(st, fd);
+    }
+    return rc;
+}
+
+// wc [-l] [-w] [-c] — только стандартный вход. Формат как у GNU wc:
+// один счётчик печатается без выравнивания, несколько — в полях по 7.
+static bool wc_accepts(char **argv) {
+    for (size_t i = 1; argv[i]; ++i) {
+        if (argv[i][0] != '-' || argv[i][1] == '\0') {
+            return false;
+        }
+        if (strspn(argv[i] + 1, "lwc") != strlen(argv[i] + 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int wc_run(sh_thread_stage_t *st) {
+    bool want_l = false, want_w = false, want_c = false;
+    for (size_t i = 1; st->argv[i]; ++i) {
+        want_l |= strchr(st->argv[i], 'l') != NULL;
+        want_w |= strchr(st->argv[i], 'w') != NULL;
+        want_c |= strchr(st->argv[i], 'c') != NULL;
+    }
+    if (!want_l && !want_w && !want_c) {
+        want_l = want_w = want_c = true;
+    }
+
+    char      buf[STAGE_BUF_SIZE];
+    long long lines = 0, words = 0, bytes = 0;
+    bool      in_word = false;
+    ssize_t   n;
+
+    while ((n = read_some(st->in_fd, buf, sizeof buf)) > 0) {
+        bytes += n;
+        for (ssize_t i = 0; i < n; ++i) {
+            unsigned char c = (unsigned char)buf[i];
+            lines += (c == '\n');
+            if (isspace(c)) {
+                in_word = false;
+            } else if (!in_word) {
+                in_word = true;
+                ++words;
+            }
+        }
+    }
+    if (n < 0) {
+        fprintf(stderr, "wc: %s\n", strerror(errno));
+        return 1;
+    }
+
+    int width = (want_l + want_w + want_c) > 1 ? 7 : 1;
+    int len   = 0;
+    char out[96];
+    const char *sep = "";
+    if (want_l) { len += snprintf(out + len, sizeof out - (size_t)len, "%s%*lld", sep, width, lines); sep = " "; }
+    if (want_w) { len += snprintf(out + len, sizeof out - (size_t)len, "%s%*lld", sep, width, words); sep = " "; }
+    if (want_c) { len += snprintf(out + len, sizeof out - (size_t)len, "%s%*lld", sep, width, bytes); }
+    out[len++] = '\n';
+
+    return write_all(st->out_fd, out, (size_t)len) ? 0 : 1;
+}
+
+// head [-n N | -N] [file] — один файл или стандартный вход.
+static bool head_parse(char **argv, long long *count, const char **path) {
+    *count = 10;
+    *path  = "-";
+    bool have_path = false;
+
+    for (size_t i = 1; argv[i]; ++i) {
+        const char *a = argv[i];
+        const char *num = NULL;
+        if (strcmp(a, "-n") == 0) {
+            num = argv[++i];
+        } else if (strncmp(a, "-n", 2) == 0) {
+            num = a + 2;
+        } else if (a[0] == '-' && isdigit((unsigned char)a[1])) {
+            num = a + 1;
+        } else if (a[0] != '-' || a[1] == '\0') {
+            if (have_path) {
+                return false;
+            }
+            *path     = a;
+            have_path = true;
+            continue;
+        } else {
+            return false;
+        }
+
+        char *end = NULL;
+        if (!num || *num == '\0') {
+            return false;
+        }
+        *count = strtoll(num, &end, 10);
+        if (*end != '\0' || *count < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool head_accepts(char **argv) {
+    long long   count;
+    const char *path;
+    return head_parse(argv, &count, &path);
 }
 
-static sh_status_t tokenize_command(char *segment, char **argv) {
-    bool   in_word = false;
-    size_t argcnt  = 0;
+static int head_run(sh_thread_stage_t *st) {
+    long long   left;
+    const char *path;
+    head_parse(st->argv, &left, &path);
+
+    int fd = stage_open(st, path);
+    if (fd < 0) {
+        return 1;
+    }
+
+    char    buf[STAGE_BUF_SIZE];
+    ssize_t n   = 0;
+    int     rc  = 0;
+    while (left > 0 && (n = read_some(fd, buf, sizeof buf)) > 0) {
+        size_t take = 0;
+        while (take < (size_t)n && left > 0) {
+            if (buf[take++] == '\n') {
+                --left;
+            }
+        }
+        if (!write_all(st->out_fd, buf, take)) {
+            rc = 1;
+            break;
+        }
+    }
+    if (n < 0) {
+        fprintf(stderr, "head: %s: %s\n", path, strerror(errno));
+        rc = 1;
+    }
+    stage_close(st, fd);
+    return rc;
+}
+
+// tee [-a] [file...]
+static bool tee_accepts(char **argv) {
+    for (size_t i = 1; argv[i]; ++i) {
+        if (argv[i][0] == '-' && strcmp(argv[i], "-a") != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int tee_run(sh_thread_stage_t *st) {
+    size_t nfiles = 0;
+    int    flags  = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    for (size_t i = 1; st->argv[i]; ++i) {
+        if (strcmp(st->argv[i], "-a") == 0) {
+            flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+        } else {
+            ++nfiles;
+        }
+    }
+
+    int    fds[nfiles + 1];
+    size_t nfds = 0;
+    int    rc   = 0;
+    for (size_t i = 1; st->argv[i]; ++i) {
+        if (strcmp(st->argv[i], "-a") == 0) {
+            continue;
+        }
+        int fd = open(st->argv[i], flags, 0664);
+        if (fd < 0) {
+            fprintf(stderr, "tee: %s: %s\n", st->argv[i], strerror(errno));
+            rc = 1;
+            continue;
+        }
+        fds[nfds++] = fd;
+    }
+
+    char    buf[STAGE_BUF_SIZE];
+    ssize_t n;
+    bool    out_ok = true;
+    while ((n = read_some(st->in_fd, buf, sizeof buf)) > 0) {
+        // Как и GNU tee, продолжаем писать в файлы, даже если читатель
+        // стандартного выхода уже ушёл.
+        if (out_ok && !write_all(st->out_fd, buf, (size_t)n)) {
+            out_ok = false;
+            rc     = 1;
+        }
+        for (size_t k = 0; k < nfds; ++k) {
+            if (fds[k] >= 0 && !write_all(fds[k], buf, (size_t)n)) {
+                fprintf(stderr, "tee: %s\n", strerror(errno));
+                close(fds[k]);
+                fds[k] = -1;
+                rc     = 1;
+            }
+        }
+    }
+
+    for (size_t k = 0; k < nfds; ++k) {
+        if (fds[k] >= 0) {
+            close(fds[k]);
+        }
+    }
+    return rc;
+}
+
+static const sh_builtin_stage_t builtin_stages[] = {
+    { "cat",  accepts_files_only, cat_run  },
+    { "wc",   wc_accepts,         wc_run   },
+    { "head", head_accepts,       head_run },
+    { "tee",  tee_accepts,        tee_run  },
+};
+
+static const sh_builtin_stage_t *find_builtin_stage(char **argv) {
+    if (!argv[0]) {
+        return NULL;
+    }
+    for (size_t i = 0; i < sizeof builtin_stages / sizeof builtin_stages[0]; ++i) {
+        if (strcmp(argv[0], builtin_stages[i].name) == 0) {
+            return builtin_stages[i].accepts(argv) ? &builtin_stages[i] : NULL;
+        }
+    }
+    return NULL;
+}
+
+static void *thread_stage_main(void *arg) {
+    sh_thread_stage_t *st = arg;
+
+    (void)st->run(st);
+
+    if (st->in_fd != STDIN_FILENO) {
+        close(st->in_fd);
+    }
+    if (st->out_fd != STDOUT_FILENO) {
+        close(st->out_fd);
+    }
+
+    if (st->stats) {
+        clock_gettime(CLOCK_MONOTONIC, &st->stats->finished);
+        getrusage(RUSAGE_THREAD, &st->stats->usage);
+        read_proc_io("/proc/thread-self/io", st->stats);
+    }
+    return NULL;
+}
+
+static sh_status_t tokenize_command(char *segment, char ***argv_out) {
+    // Верхняя оценка числа слов — чтобы выделить argv одним куском.
+    size_t max_words = 0;
+    bool   in_word   = false;
+    for (const char *c = segment; *c; ++c) {
+        bool space = isspace((unsigned char)*c);
+        max_words += (!space && !in_word);
+        in_word    = !space;
+    }
+
+    char **argv = arena_alloc(&arena, (max_words + 1) * sizeof *argv);
+    if (!argv) {
+        return SH_ERR_NOMEM;
+    }
+
+    size_t argcnt = 0;
+    in_word = false;
 
     for ( ; *segment; ++segment) {
         if (!isspace((unsigned char)*segment)) {
             if (!in_word) {
-                if (argcnt >= SHELL_ARG_MAX) {
-                    fprintf(stderr, "Unsupported argv size amount.\n");
-                    return SH_ERR_ARGV_LIMIT;
-                }
                 argv[argcnt++] = segment;
                 in_word = true;
             }
@@ -293,5 +1130,503 @@ static sh_status_t tokenize_command(char *segment, char **argv) {
     }
 
     argv[argcnt] = NULL;
+    *argv_out    = argv;
+    return SH_OK;
+}
+
+// ---------------------------------- Арена -----------------------------------
+
+static void *arena_alloc(sh_arena_t *a, size_t size) {
+    const size_t align = _Alignof(max_align_t);
+    size = (size + align - 1) & ~(align - 1);
+
+    sh_arena_block_t *b = a->head;
+    if (!b || b->cap - b->used < size) {
+        size_t cap = b ? b->cap * 2 : SHELL_ARENA_MIN;
+        while (cap < size) {
+            cap *= 2;
+        }
+
+        sh_arena_block_t *nb = malloc(sizeof *nb + cap);
+        if (!nb) {
+            perror("arena");
+            return NULL;
+        }
+        ON_DEBUG(fprintf(stderr, "\tarena: new block %zu bytes\n", cap);)
+        nb->prev  = b;
+        nb->cap   = cap;
+        nb->used  = 0;
+        a->head   = b = nb;
+        a->total += cap;
+    }
+
+    void *p = (char *)b->data + b->used;
+    b->used += size;
+    return p;
+}
+
+static void arena_free(sh_arena_t *a) {
+    while (a->head) {
+        sh_arena_block_t *prev = a->head->prev;
+        free(a->head);
+        a->head = prev;
+    }
+    a->total = 0;
+}
+
+static void arena_reset(sh_arena_t *a) {
+    if (a->head && a->head->prev) {
+        size_t total = a->total;
+        arena_free(a);
+
+        sh_arena_block_t *b = malloc(sizeof *b + total);
+        ON_DEBUG(fprintf(stderr, "\tarena: coalesced into %zu bytes\n", total);)
+        if (b) {
+            b->prev  = NULL;
+            b->cap   = total;
+            a->head  = b;
+            a->total = total;
+        }
+    }
+
+    if (a->head) {
+        a->head->used = 0;
+    }
+}
+
+// ------------------------------ Фоновые задания ------------------------------
+
+// SIGCHLD блокируется и читается через signalfd: завершившиеся фоновые
+// процессы собираются между командами и во время ожидания ввода/`wait`,
+// а не в асинхронном обработчике сигнала.
+static sh_status_t jobs_init(void) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+
+    if (sigprocmask(SIG_BLOCK, &mask, &orig_sigmask) != 0) {
+        perror("sigprocmask");
+        return SH_ERR_SIGNAL;
+    }
+
+    sigchld_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sigchld_fd < 0) {
+        perror("signalfd");
+        return SH_ERR_SIGNAL;
+    }
+
+    return SH_OK;
+}
+
+static void job_account(pid_t pid) {
+    for (size_t slot = 0; slot < SHELL_JOBS_MAX; ++slot) {
+        sh_job_t *job = &jobs[slot];
+        if (!job->used) {
+            continue;
+        }
+        for (size_t k = 0; k < job->count; ++k) {
+            if (job->pids[k] != pid) {
+                continue;
+            }
+            job->pids[k] = -1;
+            if (--job->alive == 0) {
+                if (interactive) {
+                    printf("[%zu] Done\t%s\n", slot + 1, job->cmd ? job->cmd : "");
+                }
+                free(job->cmd);
+                free(job->pids);
+                job->cmd  = NULL;
+                job->pids = NULL;
+                job->used = false;
+            }
+            return;
+        }
+    }
+}
+
+// Неблокирующий сбор: вычитывает signalfd и забирает всех зомби.
+// Вызывается только вне ожидания переднего конвейера, поэтому waitpid(-1)
+// не может забрать чужой процесс.
+static void jobs_reap(void) {
+    struct signalfd_siginfo si;
+    while (read(sigchld_fd, &si, sizeof si) == (ssize_t)sizeof si) {
+    }
+
+    pid_t pid;
+    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+        job_account(pid);
+    }
+}
+
+// Блокируется до следующего SIGCHLD и собирает завершившиеся процессы.
+static void jobs_block(void) {
+    struct pollfd pfd = { .fd = sigchld_fd, .events = POLLIN };
+    while (poll(&pfd, 1, -1) < 0 && errno == EINTR) {
+    }
+    jobs_reap();
+}
+
+static size_t jobs_active(void) {
+    size_t active = 0;
+    for (size_t slot = 0; slot < SHELL_JOBS_MAX; ++slot) {
+        active += jobs[slot].used;
+    }
+    return active;
+}
+
+// Жив ли ещё процесс pid из какого-нибудь фонового задания.
+static bool job_has_pid(pid_t pid) {
+    for (size_t slot = 0; slot < SHELL_JOBS_MAX; ++slot) {
+        const sh_job_t *job = &jobs[slot];
+        for (size_t k = 0; job->used && k < job->count; ++k) {
+            if (job->pids[k] == pid) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// wait           — дождаться всех фоновых заданий
+// wait PID       — дождаться процесса (как в POSIX; '&' печатает "[N] PID")
+// wait %N        — дождаться задания с номером N
+static sh_status_t builtin_wait(char **argv) {
+    jobs_reap();
+
+    if (!argv[1]) {
+        while (jobs_active() > 0) {
+            jobs_block();
+        }
+        return SH_OK;
+    }
+
+    for (size_t i = 1; argv[i]; ++i) {
+        bool        by_job = argv[i][0] == '%';
+        const char *arg    = by_job ? argv[i] + 1 : argv[i];
+        char       *end    = NULL;
+        long        id     = strtol(arg, &end, 10);
+
+        if (*arg == '\0' || *end != '\0' || id < 1) {
+            fprintf(stderr, "wait: %s: not a pid or %%job\n", argv[i]);
+            continue;
+        }
+
+        if (by_job) {
+            if (id > SHELL_JOBS_MAX || !jobs[id - 1].used) {
+                fprintf(stderr, "wait: %s: no such job\n", argv[i]);
+                continue;
+            }
+            while (jobs[id - 1].used) {
+                jobs_block();
+            }
+            continue;
+        }
+
+        if (!job_has_pid((pid_t)id)) {
+            fprintf(stderr, "wait: pid %ld is not a child of this shell\n", id);
+            continue;
+        }
+        while (job_has_pid((pid_t)id)) {
+            jobs_block();
+        }
+    }
+
+    return SH_OK;
+}
+
+// --------------------------------- parallel ----------------------------------
+
+// Слот parallel: запущенный процесс и memfd'ы, куда он пишет stdout/stderr.
+// Вывод копируется на терминал целиком после завершения задания, поэтому
+// строки разных заданий не перемешиваются. memfd'ы переиспользуются.
+typedef struct {
+    pid_t pid;                      // 0 — слот свободен
+    int   out_fd;
+    int   err_fd;
+} sh_par_slot_t;
+
+typedef struct {
+    char  **tmpl;                   // шаблон команды; {} заменяется аргументом
+    bool    has_marker;             // есть ли {} в шаблоне (иначе аргумент — в конец)
+    long    max_jobs;
+    double  max_load;               // <= 0 — не учитывать загрузку
+    size_t  started;
+    size_t  failed;
+} sh_parallel_t;
+
+static void par_flush_fd(int fd, int to_fd) {
+    char    buf[STAGE_BUF_SIZE];
+    off_t   off = 0;
+    ssize_t n;
+    while ((n = pread(fd, buf, sizeof buf, off)) > 0) {
+        (void)write_all(to_fd, buf, (size_t)n);
+        off += n;
+    }
+    // Смещение общее с дочерним процессом: без lseek следующее задание
+    // начнёт писать после дыры.
+    (void)ftruncate(fd, 0);
+    (void)lseek(fd, 0, SEEK_SET);
+}
+
+// Подставляет arg вместо каждого {} в строку шаблона (в дочернем процессе).
+static char *par_expand(const char *tmpl, const char *arg) {
+    size_t arg_len = strlen(arg);
+    size_t len     = strlen(tmpl);
+    for (const char *m = tmpl; (m = strstr(m, "{}")); m += 2) {
+        len += arg_len;
+    }
+
+    char *out = malloc(len + 1);
+    if (!out) {
+        return NULL;
+    }
+    char *w = out;
+    for (const char *r = tmpl; *r; ) {
+        if (r[0] == '{' && r[1] == '}') {
+            memcpy(w, arg, arg_len);
+            w += arg_len;
+            r += 2;
+        } else {
+            *w++ = *r++;
+        }
+    }
+    *w = '\0';
+    return out;
+}
+
+static void par_exec(const sh_parallel_t *par, const char *arg) {
+    size_t n = 0;
+    while (par->tmpl[n]) {
+        ++n;
+    }
+
+    char **argv = calloc(n + 2, sizeof *argv);
+    if (!argv) {
+        _exit((int)SH_ERR_NOMEM);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        argv[i] = par_expand(par->tmpl[i], arg);
+        if (!argv[i]) {
+            _exit((int)SH_ERR_NOMEM);
+        }
+    }
+    if (!par->has_marker) {
+        argv[n] = (char *)arg;
+    }
+
+    execvp(argv[0], argv);
+    perror(argv[0]);
+    _exit((int)SH_ERR_EXEC);
+}
+
+static sh_par_slot_t *par_find(sh_par_slot_t *slots, long count, pid_t pid) {
+    for (long i = 0; i < count; ++i) {
+        if (slots[i].pid == pid) {
+            return &slots[i];
+        }
+    }
+    return NULL;
+}
+
+// Забирает завершившиеся процессы. Чужие (фоновые задания) учитываются
+// как обычно, свои — выводятся и освобождают слот.
+static size_t par_reap(sh_parallel_t *par, sh_par_slot_t *slots, int options) {
+    size_t finished = 0;
+    int    status;
+    pid_t  pid;
+
+    struct signalfd_siginfo si;
+    while (read(sigchld_fd, &si, sizeof si) == (ssize_t)sizeof si) {
+    }
+
+    while ((pid = waitpid(-1, &status, options)) > 0) {
+        sh_par_slot_t *slot = par_find(slots, par->max_jobs, pid);
+        if (!slot) {
+            job_account(pid);
+            continue;
+        }
+
+        par_flush_fd(slot->out_fd, STDOUT_FILENO);
+        par_flush_fd(slot->err_fd, STDERR_FILENO);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            ++par->failed;
+        }
+        slot->pid = 0;
+        ++finished;
+        options |= WNOHANG;
+    }
+    return finished;
+}
+
+static bool par_overloaded(const sh_parallel_t *par) {
+    double load;
+    return par->max_load > 0 && getloadavg(&load, 1) == 1 && load > par->max_load;
+}
+
+static void par_start(sh_parallel_t *par, sh_par_slot_t *slot, const char *arg) {
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        sigprocmask(SIG_SETMASK, &orig_sigmask, NULL);
+        signal(SIGPIPE, SIG_DFL);
+        dup2(slot->out_fd, STDOUT_FILENO);
+        dup2(slot->err_fd, STDERR_FILENO);
+        par_exec(par, arg);
+    }
+    if (pid < 0) {
+        perror("parallel: fork");
+        ++par->failed;
+        return;
+    }
+
+    slot->pid = pid;
+    ++par->started;
+}
+
+// Ждёт свободного слота (и, с -l, пока загрузка не опустится ниже порога).
+static sh_par_slot_t *par_acquire(sh_parallel_t *par, sh_par_slot_t *slots) {
+    for (;;) {
+        par_reap(par, slots, WNOHANG);
+
+        long running = 0;
+        for (long i = 0; i < par->max_jobs; ++i) {
+            running += slots[i].pid != 0;
+        }
+
+        // Без запущенных заданий стартуем даже при высокой загрузке,
+        // иначе parallel может ждать вечно.
+        if (running < par->max_jobs && (running == 0 || !par_overloaded(par))) {
+            return par_find(slots, par->max_jobs, 0);
+        }
+
+        struct pollfd pfd = { .fd = sigchld_fd, .events = POLLIN };
+        (void)poll(&pfd, 1, running < par->max_jobs ? 1000 : -1);
+    }
+}
+
+// parallel [-j N] [-l LOAD] cmd [args with {}] ::: arg...
+// parallel [-j N] [-l LOAD] cmd [args with {}] :::: file
+// parallel [-j N] [-l LOAD] cmd [args with {}]          (аргументы — строки stdin)
+static sh_status_t builtin_parallel(char **argv) {
+    sh_parallel_t par = {0};
+    par.max_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+    size_t i = 1;
+    for ( ; argv[i] && argv[i][0] == '-'; ++i) {
+        const char *opt = argv[i];
+        const char *val = opt[2] ? opt + 2 : argv[++i];
+        char       *end = NULL;
+
+        if (!val || (opt[1] != 'j' && opt[1] != 'l')) {
+            fprintf(stderr, "parallel: bad option %s\n", opt);
+            return SH_OK;
+        }
+        if (opt[1] == 'j') {
+            par.max_jobs = strtol(val, &end, 10);
+        } else {
+            par.max_load = strtod(val, &end);
+        }
+        if (*end != '\0') {
+            fprintf(stderr, "parallel: bad value for %s: %s\n", opt, val);
+            return SH_OK;
+        }
+    }
+    if (par.max_jobs < 1) {
+        par.max_jobs = 1;
+    }
+
+    par.tmpl = argv + i;
+    size_t n = 0;
+    while (argv[i + n] && strcmp(argv[i + n], ":::") != 0 && strcmp(argv[i + n], "::::") != 0) {
+        par.has_marker |= strstr(argv[i + n], "{}") != NULL;
+        ++n;
+    }
+    if (n == 0) {
+        fprintf(stderr, "parallel: missing command\n");
+        return SH_OK;
+    }
+
+    char **list   = NULL;
+    FILE  *source = NULL;
+    if (argv[i + n] && strcmp(argv[i + n], ":::") == 0) {
+        list = argv + i + n + 1;
+    } else if (argv[i + n]) {
+        if (!argv[i + n + 1]) {
+            fprintf(stderr, "parallel: :::: needs a file\n");
+            return SH_OK;
+        }
+        source = fopen(argv[i + n + 1], "r");
+        if (!source) {
+            perror(argv[i + n + 1]);
+            return SH_OK;
+        }
+    } else {
+        source = stdin;
+    }
+    argv[i + n] = NULL;
+
+    sh_par_slot_t *slots = arena_alloc(&arena, (size_t)par.max_jobs * sizeof *slots);
+    if (!slots) {
+        return SH_ERR_NOMEM;
+    }
+    for (long k = 0; k < par.max_jobs; ++k) {
+        slots[k].pid    = 0;
+        slots[k].out_fd = memfd_create("parallel-out", MFD_CLOEXEC);
+        slots[k].err_fd = memfd_create("parallel-err", MFD_CLOEXEC);
+        if (slots[k].out_fd < 0 || slots[k].err_fd < 0) {
+            perror("memfd_create");
+            par.max_jobs = k;
+            close_if_open(&slots[k].out_fd);
+            close_if_open(&slots[k].err_fd);
+            break;
+        }
+    }
+
+    if (par.max_jobs > 0) {
+        if (list) {
+            for ( ; *list; ++list) {
+                par_start(&par, par_acquire(&par, slots), *list);
+            }
+        } else {
+            char   *arg = NULL;
+            size_t  cap = 0;
+            ssize_t len;
+            while ((len = getline(&arg, &cap, source)) >= 0) {
+                if (len > 0 && arg[len - 1] == '\n') {
+                    arg[--len] = '\0';
+                }
+                if (len > 0) {
+                    par_start(&par, par_acquire(&par, slots), arg);
+                }
+            }
+            free(arg);
+        }
+    }
+
+    for (;;) {
+        long running = 0;
+        for (long k = 0; k < par.max_jobs; ++k) {
+            running += slots[k].pid != 0;
+        }
+        if (running == 0) {
+            break;
+        }
+        par_reap(&par, slots, 0);
+    }
+
+    for (long k = 0; k < par.max_jobs; ++k) {
+        close(slots[k].out_fd);
+        close(slots[k].err_fd);
+    }
+    if (source == stdin) {
+        clearerr(stdin);
+    } else if (source) {
+        fclose(source);
+    }
+
+    if (par.failed > 0) {
+        fprintf(stderr, "parallel: %zu of %zu jobs failed\n", par.failed, par.started);
+    }
     return SH_OK;
 }
@@ -1,9 +1,37 @@
 #include <stdio.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <mqueue.h>
 #include <unistd.h>
 #include <sys/msg.h>
 #include <stdlib.h>
 #include <sys/wait.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#define STADION_CORO 1
+#endif
+
+#include "tsc_clock.h"
 
 bool is_child_process(pid_t proc_id) { return !proc_id; }
 
@@ -25,9 +53,6 @@ static int Msgget() {
     return queue_id;
 }
 
-static int runner(int total_runners, int runner_idx, int queue_id);
-static int judge(int total_runners, int queue_id);
-
 enum stadium_status_t {
     STADIUM_STATUS_SPAWNED = 1,
     STADIUM_STATUS_ADVANCE = 2,
@@ -39,82 +64,761 @@ struct msg_t {
     stadium_status_t status;
 };
 
-int main(int ac, const char *av[]) {
-    if (ac != 2) {
-        fprintf(stderr, "ERROR, YOU SHOULD ENTER N RUNNERS\n");
+// ------------------------------- Транспорты ---------------------------------
+//
+// Эстафета не зависит от механизма IPC: бегун отмечается у судьи (check_in),
+// ждёт палочку в своём слоте (wait_baton) и передаёт её в следующий (pass).
+// Слоты 1..N — бегуны, слот N+1 — финиш у судьи. Все объекты создаются до
+// fork(), поэтому дочерние процессы пользуются унаследованными дескрипторами.
+
+struct Transport {
+    virtual ~Transport() = default;
+    virtual const char* name() const = 0;
+    virtual void check_in(int runner_idx) = 0;
+    // Номер отметившегося бегуна или 0, если механизм его не передаёт.
+    virtual int  wait_check_in() = 0;
+    virtual void pass(int slot) = 0;
+    virtual void wait_baton(int slot) = 0;
+    // Освобождение объектов ядра; вызывается один раз родителем.
+    virtual void destroy() {}
+};
+
+static void* shared_alloc(size_t size) {
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap shared");
         _exit(1);
     }
-    int runner_count = atoi(av[1]); 
+    return p;
+}
 
-    int queue_id_main = Msgget();
+static void write_full(int fd, const void* buf, size_t size, const char* what) {
+    const char* p = static_cast<const char*>(buf);
+    while (size > 0) {
+        ssize_t m = write(fd, p, size);
+        if (m < 0 && errno == EINTR) continue;
+        if (m <= 0) { perror(what); _exit(1); }
+        p += m;
+        size -= (size_t)m;
+    }
+}
 
-    pid_t arbiter_pid = Fork();
-    if (is_child_process(arbiter_pid)) {
-        return judge(runner_count, queue_id_main);
+static void read_full(int fd, void* buf, size_t size, const char* what) {
+    char* p = static_cast<char*>(buf);
+    while (size > 0) {
+        ssize_t m = read(fd, p, size);
+        if (m < 0 && errno == EINTR) continue;
+        if (m <= 0) { perror(what); _exit(1); }
+        p += m;
+        size -= (size_t)m;
     }
-    
-    for (int idx = 1; idx <= runner_count; ++idx) {
-        pid_t sprinter_pid = Fork();
-        if (is_child_process(sprinter_pid)) {
-            return runner(runner_count, idx, queue_id_main);
+}
+
+// Одна очередь System V, адресация через mtype:
+// check-in — тип runner_idx + 1, палочка слота s — тип N + 2 + s.
+struct SysvTransport : Transport {
+    int queue_id;
+    int total;
+
+    explicit SysvTransport(int n) : queue_id(Msgget()), total(n) {}
+    const char* name() const override { return "sysv"; }
+
+    void check_in(int runner_idx) override {
+        msg_t packet;
+        packet.mtype  = runner_idx + 1;
+        packet.status = STADIUM_STATUS_SPAWNED;
+        if (msgsnd(queue_id, &packet, sizeof(packet.status), 0) == -1) {
+            perror("runner: msgsnd(hello)");
+            _exit(1);
         }
     }
+    int wait_check_in() override {
+        msg_t packet;
+        if (msgrcv(queue_id, &packet, sizeof(packet.status), -(long)(total + 1), 0) == -1) {
+            perror("judge: msgrcv");
+            _exit(1);
+        }
+        return (int)packet.mtype - 1;
+    }
+    void pass(int slot) override {
+        msg_t packet;
+        packet.mtype  = total + 2 + slot;
+        packet.status = STADIUM_STATUS_ADVANCE;
+        if (msgsnd(queue_id, &packet, sizeof(packet.status), 0) == -1) {
+            perror("msgsnd(baton)");
+            _exit(1);
+        }
+    }
+    void wait_baton(int slot) override {
+        msg_t packet;
+        if (msgrcv(queue_id, &packet, sizeof(packet.status), total + 2 + slot, 0) == -1) {
+            perror("msgrcv(baton)");
+            _exit(1);
+        }
+        if (packet.status != STADIUM_STATUS_ADVANCE) {
+            fprintf(stderr, "slot %d :: unexpected status = %d\n", slot, packet.status);
+            _exit(1);
+        }
+    }
+    void destroy() override {
+        if (msgctl(queue_id, IPC_RMID, 0) == -1) {
+            perror("DELETE ERROR");
+        }
+    }
+};
+
+// Очереди POSIX: своя очередь на каждый слот плюс очередь check-in.
+// Упирается в /proc/sys/fs/mqueue/queues_max.
+struct MqTransport : Transport {
+    std::vector<mqd_t> baton;
+    mqd_t              checkin;
+    pid_t              owner;
 
-    for (int wait_idx = 0; wait_idx < runner_count + 1; ++wait_idx) {
-        wait(NULL);
+    static mqd_t open_queue(const char* name) {
+        struct mq_attr attr = {};
+        attr.mq_maxmsg  = 10;
+        attr.mq_msgsize = sizeof(int);
+        mqd_t q = mq_open(name, O_CREAT | O_EXCL | O_RDWR, 0600, &attr);
+        if (q == (mqd_t)-1) {
+            fprintf(stderr, "mq_open('%s'): %s\n", name, strerror(errno));
+            _exit(1);
+        }
+        return q;
+    }
+    void queue_name(char* buf, size_t size, int slot) const {
+        snprintf(buf, size, "/stadion_%ld_%d", (long)owner, slot);
     }
 
-    if (msgctl(queue_id_main, IPC_RMID, 0) == -1) {
-        perror("DELETE ERROR");
-        _exit(1);
+    explicit MqTransport(int n) : baton((size_t)n + 2), owner(getpid()) {
+        char qname[64];
+        for (int s = 0; s <= n + 1; ++s) {
+            queue_name(qname, sizeof(qname), s);
+            mqd_t q = open_queue(qname);
+            if (s == 0) checkin = q; else baton[(size_t)s] = q;
+        }
     }
-}
+    const char* name() const override { return "mq"; }
 
-static int judge(int total_runners, int queue_id) {
-    msg_t packet;
-    printf("Judge >>> init\n");
+    void check_in(int runner_idx) override {
+        if (mq_send(checkin, (const char*)&runner_idx, sizeof(runner_idx), 0) != 0) {
+            perror("runner: mq_send(hello)");
+            _exit(1);
+        }
+    }
+    int wait_check_in() override {
+        int idx;
+        if (mq_receive(checkin, (char*)&idx, sizeof(idx), nullptr) < 0) {
+            perror("judge: mq_receive(checkin)");
+            _exit(1);
+        }
+        return idx;
+    }
+    void pass(int slot) override {
+        int status = STADIUM_STATUS_ADVANCE;
+        if (mq_send(baton[(size_t)slot], (const char*)&status, sizeof(status), 0) != 0) {
+            perror("mq_send(baton)");
+            _exit(1);
+        }
+    }
+    void wait_baton(int slot) override {
+        int status;
+        if (mq_receive(baton[(size_t)slot], (char*)&status, sizeof(status), nullptr) < 0) {
+            perror("mq_receive(baton)");
+            _exit(1);
+        }
+    }
+    void destroy() override {
+        char qname[64];
+        for (size_t s = 0; s < baton.size(); ++s) {
+            queue_name(qname, sizeof(qname), (int)s);
+            mq_close(s == 0 ? checkin : baton[s]);
+            mq_unlink(qname);
+        }
+    }
+};
 
-    for (int arrive_cnt = 0; arrive_cnt++ < total_runners; ) {
-        if (msgrcv(queue_id, &packet, sizeof(packet), 0, 0) == -1) {
-            perror("judge: msgrcv");
+// Каналы (pipe) и потоковые UNIX-сокеты: по паре дескрипторов на слот.
+// Check-in — общий канал/датаграммный сокет, запись int атомарна.
+struct FdPairTransport : Transport {
+    std::vector<int> rd, wr;
+    int  checkin_rd = -1, checkin_wr = -1;
+    bool sockets;
+
+    static void make_pair(bool sock, int type, int* r, int* w) {
+        int fds[2];
+        int rc = sock ? socketpair(AF_UNIX, type, 0, fds) : pipe(fds);
+        if (rc != 0) {
+            perror(sock ? "socketpair" : "pipe");
             _exit(1);
         }
-        printf("Judge >>> check-in by runner type=%ld\n", (long)packet.mtype);
+        *r = fds[0];
+        *w = fds[1];
     }
-    puts("Judge >>> everyone is on the track");
 
-    packet.mtype  = 1;
-    packet.status = STADIUM_STATUS_READY;
-    if (msgsnd(queue_id, &packet, sizeof(packet), 0) == -1) {
-        perror("judge: msgsnd(all-created)");
+    FdPairTransport(int n, bool sock) : rd((size_t)n + 2, -1), wr((size_t)n + 2, -1), sockets(sock) {
+        make_pair(sock, SOCK_DGRAM, &checkin_rd, &checkin_wr);
+        for (int s = 1; s <= n + 1; ++s) {
+            make_pair(sock, SOCK_STREAM, &rd[(size_t)s], &wr[(size_t)s]);
+        }
+    }
+    const char* name() const override { return sockets ? "unix" : "pipe"; }
+
+    void check_in(int runner_idx) override {
+        write_full(checkin_wr, &runner_idx, sizeof(runner_idx), "runner: write(hello)");
+    }
+    int wait_check_in() override {
+        int idx;
+        read_full(checkin_rd, &idx, sizeof(idx), "judge: read(checkin)");
+        return idx;
+    }
+    void pass(int slot) override {
+        int status = STADIUM_STATUS_ADVANCE;
+        write_full(wr[(size_t)slot], &status, sizeof(status), "write(baton)");
+    }
+    void wait_baton(int slot) override {
+        int status;
+        read_full(rd[(size_t)slot], &status, sizeof(status), "read(baton)");
+    }
+};
+
+// eventfd в режиме семафора: палочка — +1 на eventfd слота.
+struct EventfdTransport : Transport {
+    std::vector<int> fd;
+    int checkin;
+
+    static int make_fd() {
+        int e = eventfd(0, EFD_SEMAPHORE);
+        if (e < 0) {
+            perror("eventfd");
+            _exit(1);
+        }
+        return e;
+    }
+
+    explicit EventfdTransport(int n) : fd((size_t)n + 2, -1), checkin(make_fd()) {
+        for (int s = 1; s <= n + 1; ++s) fd[(size_t)s] = make_fd();
+    }
+    const char* name() const override { return "eventfd"; }
+
+    void check_in(int) override {
+        uint64_t one = 1;
+        write_full(checkin, &one, sizeof(one), "runner: write(eventfd hello)");
+    }
+    int wait_check_in() override {
+        uint64_t v;
+        read_full(checkin, &v, sizeof(v), "judge: read(eventfd checkin)");
+        return 0;
+    }
+    void pass(int slot) override {
+        uint64_t one = 1;
+        write_full(fd[(size_t)slot], &one, sizeof(one), "write(eventfd baton)");
+    }
+    void wait_baton(int slot) override {
+        uint64_t v;
+        read_full(fd[(size_t)slot], &v, sizeof(v), "read(eventfd baton)");
+    }
+};
+
+static long futex(std::atomic<uint32_t>* word, int op, uint32_t val) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), op, val, nullptr, nullptr, 0);
+}
+
+// futex-слова в общей памяти, каждое на своей кэш-линии.
+// Check-in — массив номеров: бегун занимает позицию fetch_add'ом,
+// судья ждёт позиции по порядку.
+struct FutexTransport : Transport {
+    struct alignas(64) Word {
+        std::atomic<uint32_t> v;
+    };
+
+    Word*  baton;
+    Word*  checkin;
+    std::atomic<uint32_t>* checkin_head;
+    int    checkin_tail = 0;
+    size_t bytes;
+
+    explicit FutexTransport(int n) {
+        size_t words = (size_t)n + 2 + (size_t)n + 1;
+        bytes   = words * sizeof(Word);
+        Word* w = static_cast<Word*>(shared_alloc(bytes));
+        for (size_t i = 0; i < words; ++i) new (&w[i]) Word{};
+        baton        = w;
+        checkin      = w + n + 2;
+        checkin_head = &checkin[n].v;
+    }
+    const char* name() const override { return "futex"; }
+
+    void check_in(int runner_idx) override {
+        uint32_t pos = checkin_head->fetch_add(1, std::memory_order_relaxed);
+        checkin[pos].v.store((uint32_t)runner_idx, std::memory_order_release);
+        futex(&checkin[pos].v, FUTEX_WAKE, 1);
+    }
+    int wait_check_in() override {
+        std::atomic<uint32_t>* w = &checkin[checkin_tail++].v;
+        uint32_t idx;
+        while ((idx = w->load(std::memory_order_acquire)) == 0) {
+            futex(w, FUTEX_WAIT, 0);
+        }
+        return (int)idx;
+    }
+    void pass(int slot) override {
+        baton[slot].v.store(1, std::memory_order_release);
+        futex(&baton[slot].v, FUTEX_WAKE, 1);
+    }
+    void wait_baton(int slot) override {
+        std::atomic<uint32_t>* w = &baton[slot].v;
+        while (w->load(std::memory_order_acquire) == 0) {
+            futex(w, FUTEX_WAIT, 0);
+        }
+        w->store(0, std::memory_order_relaxed);
+    }
+    void destroy() override { munmap(baton, bytes); }
+};
+
+static Transport* make_transport(const char* kind, int n) {
+    if (!strcmp(kind, "sysv"))    return new SysvTransport(n);
+    if (!strcmp(kind, "mq"))      return new MqTransport(n);
+    if (!strcmp(kind, "pipe"))    return new FdPairTransport(n, false);
+    if (!strcmp(kind, "unix"))    return new FdPairTransport(n, true);
+    if (!strcmp(kind, "eventfd")) return new EventfdTransport(n);
+    if (!strcmp(kind, "futex"))   return new FutexTransport(n);
+    return nullptr;
+}
+
+// --------------------------- Барьер check-in ---------------------------------
+//
+// -b F заменяет check-in через транспорт комбинирующим деревом с
+// ветвлением F в общей памяти. Бегун увеличивает счётчик своего листа;
+// последний пришедший в узел поднимается к родителю, последний в корне
+// будит судью. В каждый счётчик приходит не больше F участников, и при
+// N бегунах нет единой точки конкуренции, как у очереди check-in.
+
+struct CheckinTree {
+    struct alignas(64) Node {
+        std::atomic<uint32_t> count;
+        uint32_t              expected;
+        int32_t               parent;      // -1 у корня
+    };
+
+    Node*  nodes;
+    std::atomic<uint32_t>* done;           // 1 — все на дорожке (futex)
+    int    fan_in;
+    size_t bytes;
+
+    CheckinTree(int n, int f) : fan_in(f) {
+        // Уровни снизу вверх: листья над бегунами, затем узлы над узлами.
+        std::vector<size_t> level_size;
+        size_t width = (size_t)n;
+        do {
+            width = (width + (size_t)f - 1) / (size_t)f;
+            level_size.push_back(width);
+        } while (width > 1);
+
+        size_t total = 0;
+        for (size_t w : level_size) total += w;
+        bytes = (total + 1) * sizeof(Node);
+        nodes = static_cast<Node*>(shared_alloc(bytes));
+        done  = &nodes[total].count;
+
+        size_t base = 0, below = (size_t)n;
+        for (size_t lvl = 0; lvl < level_size.size(); ++lvl) {
+            size_t next_base = base + level_size[lvl];
+            for (size_t i = 0; i < level_size[lvl]; ++i) {
+                Node* node = new (&nodes[base + i]) Node{};
+                size_t first = i * (size_t)f;
+                node->expected = (uint32_t)std::min((size_t)f, below - first);
+                node->parent   = lvl + 1 < level_size.size() ? (int32_t)(next_base + i / (size_t)f) : -1;
+            }
+            below = level_size[lvl];
+            base  = next_base;
+        }
+        new (done) std::atomic<uint32_t>(0);
+    }
+
+    void arrive(int runner_idx) {
+        int32_t node = (runner_idx - 1) / fan_in;
+        while (node >= 0) {
+            Node& nd = nodes[node];
+            if (nd.count.fetch_add(1, std::memory_order_acq_rel) + 1 != nd.expected) return;
+            node = nd.parent;
+        }
+        done->store(1, std::memory_order_release);
+        futex(done, FUTEX_WAKE, 1);
+    }
+
+    void wait_all() {
+        while (done->load(std::memory_order_acquire) == 0) {
+            futex(done, FUTEX_WAIT, 0);
+        }
+    }
+
+    ~CheckinTree() { munmap(nodes, bytes); }
+};
+
+// ------------------------------ Размещение ----------------------------------
+//
+// -a задаёт, куда ставить соседних участников эстафеты (судья — слот 0):
+//   same   — все на одно логическое ядро;
+//   smt    — поочерёдно на два hyperthread-брата одного физического ядра;
+//   cross  — по кругу на разные физические ядра (по одному CPU с ядра).
+// Шаблон CPU повторяется: слот s ставится на pattern[s % pattern.size()].
+
+enum placement_t { PLACE_NONE, PLACE_SAME, PLACE_SMT, PLACE_CROSS };
+
+static int read_sysfs_int(int cpu, const char* leaf) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, leaf);
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+    int v = -1;
+    if (fscanf(f, "%d", &v) != 1) v = -1;
+    fclose(f);
+    return v;
+}
+
+static std::vector<int> placement_pattern(placement_t kind) {
+    std::vector<int> pattern;
+    if (kind == PLACE_NONE) return pattern;
+
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        perror("sched_getaffinity");
         _exit(1);
     }
 
-    struct timeval t_begin;
-    if (gettimeofday(&t_begin, NULL) != 0) {
-        perror("judge: gettimeofday(start)");
+    // Разрешённые CPU, сгруппированные по физическому ядру (package, core_id).
+    std::vector<std::pair<std::pair<int, int>, std::vector<int>>> cores;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, &allowed)) continue;
+        std::pair<int, int> key(read_sysfs_int(cpu, "physical_package_id"),
+                                read_sysfs_int(cpu, "core_id"));
+        if (key.second < 0) key.second = cpu;
+        size_t c = 0;
+        while (c < cores.size() && cores[c].first != key) ++c;
+        if (c == cores.size()) cores.push_back({key, {}});
+        cores[c].second.push_back(cpu);
+    }
+    if (cores.empty()) return pattern;
+
+    switch (kind) {
+        case PLACE_SAME:
+            pattern.push_back(cores[0].second[0]);
+            break;
+        case PLACE_SMT:
+            for (const auto& core : cores) {
+                if (core.second.size() >= 2) {
+                    pattern.push_back(core.second[0]);
+                    pattern.push_back(core.second[1]);
+                    break;
+                }
+            }
+            if (pattern.empty()) {
+                fprintf(stderr, "placement: no SMT siblings available, using one CPU\n");
+                pattern.push_back(cores[0].second[0]);
+            }
+            break;
+        case PLACE_CROSS:
+            for (const auto& core : cores) pattern.push_back(core.second[0]);
+            if (pattern.size() < 2) {
+                fprintf(stderr, "placement: only one physical core available\n");
+            }
+            break;
+        case PLACE_NONE:
+            break;
+    }
+    return pattern;
+}
+
+// ------------------------------- Забег --------------------------------------
+
+struct Race {
+    Transport* track;              // nullptr в режиме корутин
+    int        total_runners;
+    int        laps;
+    bool       threaded;           // бегуны — std::thread, а не процессы
+    std::vector<int> cpu_pattern;  // пусто — без привязки к CPU
+    bool       verbose;            // печать GO/DONE — только в однокруговом режиме
+    CheckinTree* barrier;          // nullptr — check-in через транспорт
+    // Фазы старта (нс): [0] — начало запуска, [1] — все запущены,
+    // [2] — судья дождался всех check-in.
+    uint64_t*  phase_ns;
+    // Отметки передачи палочки в тиках race_tick(): кольцо на ring кругов,
+    // ts[slot * ring + lap % ring]. У каждого бегуна свой непрерывный кусок,
+    // чтобы соседи не делили кэш-линии.
+    uint64_t*  recv_ts;
+    uint64_t*  send_ts;
+    size_t     ring;
+    bool       trace;              // -T: без stdio на пути палочки, отчёт по переходам
+    bool       use_tsc;            // тики — rdtsc, иначе наносекунды
+    double     ns_per_tick;
+    const char* dump_path;         // -o: сырые задержки переходов
+};
+
+// Кольцо трассировки хранит не больше стольких последних кругов.
+constexpr size_t TRACE_RING_LAPS = 4096;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static const char* track_name(const Race& race) {
+    return race.track ? race.track->name() : "coro";
+}
+
+static inline uint64_t race_tick(const Race& race) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (race.use_tsc) return __rdtsc();
+#endif
+    return raw_ns();
+}
+
+// Привязка текущего участника: процесс — sched_setaffinity,
+// поток — pthread_setaffinity_np.
+static void pin_self(const Race& race, int slot) {
+    if (race.cpu_pattern.empty()) return;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(race.cpu_pattern[(size_t)slot % race.cpu_pattern.size()], &set);
+
+    int err = race.threaded ? pthread_setaffinity_np(pthread_self(), sizeof(set), &set)
+                            : (sched_setaffinity(0, sizeof(set), &set) == 0 ? 0 : errno);
+    if (err != 0) {
+        fprintf(stderr, "slot %d: set affinity: %s\n", slot, strerror(err));
         _exit(1);
     }
+}
 
-    {
-        const long offset_base = total_runners + 1;
-        packet.mtype  = offset_base + 2;
-        packet.status = STADIUM_STATUS_ADVANCE;
-        if (msgsnd(queue_id, &packet, sizeof(packet), 0) == -1) {
-            perror("judge: msgsnd(start-first)");
-            _exit(1);
+static int runner(const Race& race, int runner_idx);
+static int judge(const Race& race);
+static void judge_results(const Race& race, const struct timeval& t_begin);
+static void report_hops(const Race& race);
+#ifdef STADION_CORO
+static void coro_race(Race& race, int workers);
+#endif
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "usage: %s [-t sysv|mq|pipe|eventfd|unix|futex] [-k laps] [-m process|thread|coro]\n"
+            "          [-w workers] [-a same|smt|cross] [-b fan-in] [-q] [-T] [-o file] N\n"
+            "  -t  transport for check-in and baton hand-off (default sysv)\n"
+            "  -k  run K laps and print per-hop latency percentiles\n"
+            "  -m  run runners as processes (default), threads or coroutines (-std=c++20)\n"
+            "  -w  with -m coro: number of worker threads (default min(4, CPUs))\n"
+            "  -a  pin consecutive runners to the same CPU, SMT siblings or different cores\n"
+            "  -b  check in through a shared-memory combining tree with this fan-in\n"
+            "  -q  no per-runner output\n"
+            "  -T  trace mode: no stdio on the hop path, TSC timestamps, hop report\n"
+            "  -o  with -T or -k: write raw per-hop latencies (lap slot ns) to file\n",
+            prog);
+    _exit(1);
+}
+
+int main(int ac, char *av[]) {
+    const char* kind = "sysv";
+    int laps = 1;
+    bool threaded = false;
+    bool coro = false;
+    int workers = (int)std::min(4u, std::max(1u, std::thread::hardware_concurrency()));
+    placement_t placement = PLACE_NONE;
+    int fan_in = 0;
+    bool quiet = false;
+    bool trace = false;
+    const char* dump_path = nullptr;
+
+    int opt;
+    while ((opt = getopt(ac, av, "t:k:m:w:a:b:qTo:")) != -1) {
+        switch (opt) {
+            case 'T': trace = true;         break;
+            case 'o': dump_path = optarg;   break;
+            case 'b': fan_in = atoi(optarg); break;
+            case 'q': quiet = true;          break;
+            case 't': kind = optarg;       break;
+            case 'k': laps = atoi(optarg); break;
+            case 'w': workers = atoi(optarg); break;
+            case 'm':
+                if      (!strcmp(optarg, "process")) threaded = false;
+                else if (!strcmp(optarg, "thread"))  threaded = true;
+                else if (!strcmp(optarg, "coro"))    threaded = coro = true;
+                else usage(av[0]);
+                break;
+            case 'a':
+                if      (!strcmp(optarg, "same"))  placement = PLACE_SAME;
+                else if (!strcmp(optarg, "smt"))   placement = PLACE_SMT;
+                else if (!strcmp(optarg, "cross")) placement = PLACE_CROSS;
+                else usage(av[0]);
+                break;
+            default:  usage(av[0]);
         }
     }
+    if (optind + 1 != ac) {
+        fprintf(stderr, "ERROR, YOU SHOULD ENTER N RUNNERS\n");
+        usage(av[0]);
+    }
+    int runner_count = atoi(av[optind]);
+    if (runner_count <= 0 || laps <= 0) {
+        fprintf(stderr, "N and K must be positive\n");
+        _exit(1);
+    }
+    if (fan_in < 0 || fan_in == 1) {
+        fprintf(stderr, "fan-in must be at least 2\n");
+        _exit(1);
+    }
+    if (workers <= 0) {
+        fprintf(stderr, "need at least one worker thread\n");
+        _exit(1);
+    }
+#ifndef STADION_CORO
+    if (coro) {
+        fprintf(stderr, "coroutine mode is not built in: compile with -std=c++20\n");
+        _exit(1);
+    }
+#endif
+    if (coro && fan_in) {
+        fprintf(stderr, "-b is ignored with -m coro: runners check in through one counter\n");
+        fan_in = 0;
+    }
 
-    {
-        const long offset_base = total_runners + 1;
-        const long final_mtype = offset_base + total_runners + 2;
-        if (msgrcv(queue_id, &packet, sizeof(packet), final_mtype, 0) == -1) {
-            perror("judge: msgrcv(last-finish)");
-            _exit(1);
+    // Дескрипторные транспорты держат 2(N+1) fd в каждом процессе.
+    struct rlimit nofile;
+    if (getrlimit(RLIMIT_NOFILE, &nofile) == 0 && nofile.rlim_cur < nofile.rlim_max) {
+        nofile.rlim_cur = nofile.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &nofile);
+    }
+
+    Race race;
+    race.track = coro ? nullptr : make_transport(kind, runner_count);
+    if (!race.track && !coro) {
+        fprintf(stderr, "unknown transport '%s'\n", kind);
+        usage(av[0]);
+    }
+    race.total_runners = runner_count;
+    race.laps          = laps;
+    race.threaded      = threaded;
+    race.cpu_pattern   = placement_pattern(placement);
+    race.verbose       = laps == 1 && !quiet && !trace;
+    race.barrier       = fan_in ? new CheckinTree(runner_count, fan_in) : nullptr;
+    race.phase_ns      = static_cast<uint64_t*>(shared_alloc(3 * sizeof(uint64_t)));
+
+    if (!race.cpu_pattern.empty()) {
+        printf("placement: cpus");
+        for (int cpu : race.cpu_pattern) printf(" %d", cpu);
+        printf(" (repeating)\n");
+        fflush(stdout);
+    }
+
+    race.dump_path   = dump_path;
+    race.trace       = trace;
+    race.use_tsc     = trace && tsc_usable();
+    race.ns_per_tick = race.use_tsc ? calibrate_tsc() : 1.0;
+    if (trace) {
+        if (race.use_tsc) printf("trace: TSC, %.4f ns/tick\n", race.ns_per_tick);
+        else              printf("trace: CLOCK_MONOTONIC_RAW (no invariant TSC)\n");
+        fflush(stdout);
+    }
+
+    // Кольца выделяются заранее, до запуска участников.
+    race.ring = std::min((size_t)laps, TRACE_RING_LAPS);
+    size_t stamp_bytes = (size_t)(runner_count + 2) * race.ring * sizeof(uint64_t);
+    race.recv_ts = static_cast<uint64_t*>(shared_alloc(stamp_bytes));
+    race.send_ts = static_cast<uint64_t*>(shared_alloc(stamp_bytes));
+
+    if (coro) {
+#ifdef STADION_CORO
+        coro_race(race, workers);
+#endif
+    } else if (threaded) {
+        std::vector<std::thread> crew;
+        crew.reserve((size_t)runner_count + 1);
+        race.phase_ns[0] = now_ns();
+        crew.emplace_back([&race] { judge(race); });
+        for (int idx = 1; idx <= runner_count; ++idx) {
+            crew.emplace_back([&race, idx] { runner(race, idx); });
+        }
+        race.phase_ns[1] = now_ns();
+        for (std::thread& t : crew) t.join();
+    } else {
+        fflush(stdout);
+
+        race.phase_ns[0] = now_ns();
+        pid_t arbiter_pid = Fork();
+        if (is_child_process(arbiter_pid)) {
+            return judge(race);
+        }
+
+        for (int idx = 1; idx <= runner_count; ++idx) {
+            pid_t sprinter_pid = Fork();
+            if (is_child_process(sprinter_pid)) {
+                return runner(race, idx);
+            }
+        }
+        race.phase_ns[1] = now_ns();
+
+        for (int wait_idx = 0; wait_idx < runner_count + 1; ++wait_idx) {
+            wait(NULL);
+        }
+    }
+
+    // Старт (запуск всех участников + сбор check-in) отдельно от забега.
+    printf("start-up: %.3f ms (spawn %.3f ms, check-in %s)\n",
+           (double)(race.phase_ns[2] - race.phase_ns[0]) / 1.0e6,
+           (double)(race.phase_ns[1] - race.phase_ns[0]) / 1.0e6,
+           race.barrier ? "combining tree" : track_name(race));
+
+    delete race.barrier;
+    munmap(race.phase_ns, 3 * sizeof(uint64_t));
+    if (race.track) race.track->destroy();
+    munmap(race.recv_ts, stamp_bytes);
+    munmap(race.send_ts, stamp_bytes);
+    delete race.track;
+    return EXIT_SUCCESS;
+}
+
+static int judge(const Race& race) {
+    const int total_runners = race.total_runners;
+    const int finish        = total_runners + 1;
+    pin_self(race, 0);
+    printf("Judge >>> init (%s, %s)\n", race.track->name(), race.threaded ? "threads" : "processes");
+
+    if (race.barrier) {
+        race.barrier->wait_all();
+    } else {
+        for (int arrive_cnt = 0; arrive_cnt++ < total_runners; ) {
+            int idx = race.track->wait_check_in();
+            if (race.verbose) {
+                if (idx > 0) printf("Judge >>> check-in by runner idx=%d\n", idx);
+                else         printf("Judge >>> check-in #%d\n", arrive_cnt);
+            }
         }
     }
+    race.phase_ns[2] = now_ns();
+    puts("Judge >>> everyone is on the track");
+    fflush(stdout);
+
+    struct timeval t_begin;
+    if (gettimeofday(&t_begin, NULL) != 0) {
+        perror("judge: gettimeofday(start)");
+        _exit(1);
+    }
+
+    uint64_t* start_send  = race.send_ts;
+    uint64_t* finish_recv = race.recv_ts + (size_t)finish * race.ring;
+
+    for (int lap = 0; lap < race.laps; ++lap) {
+        start_send[(size_t)lap % race.ring] = race_tick(race);
+        race.track->pass(1);
+        race.track->wait_baton(finish);
+        finish_recv[(size_t)lap % race.ring] = race_tick(race);
+    }
 
+    judge_results(race, t_begin);
+    return EXIT_SUCCESS;
+}
+
+// Итог забега у судьи: время от старта t_begin и задержки переходов.
+static void judge_results(const Race& race, const struct timeval& t_begin) {
     struct timeval t_end;
     if (gettimeofday(&t_end, NULL) != 0) {
         perror("judge: gettimeofday(end)");
@@ -124,47 +828,393 @@ static int judge(int total_runners, int queue_id) {
     double ms_end   = (double)t_end.tv_sec   * 1.0e3 + (double)t_end.tv_usec   / 1.0e3;
     double ms_start = (double)t_begin.tv_sec * 1.0e3 + (double)t_begin.tv_usec / 1.0e3;
     printf("Judge >>> elapsed: %.3f ms\n", ms_end - ms_start);
+    if (race.laps > 1) {
+        printf("Judge >>> %d laps, %.3f us per lap\n",
+               race.laps, (ms_end - ms_start) * 1.0e3 / race.laps);
+    }
+
+    // Последняя палочка пришла — все отметки бегунов уже записаны.
+    if (race.laps > 1 || race.trace) {
+        report_hops(race);
+    }
+}
+
+static int runner(const Race& race, int runner_idx) {
+    pin_self(race, runner_idx);
+    if (race.verbose) {
+        printf("Runner %3d :: hello -> judge\n", runner_idx);
+    }
+    if (race.barrier) race.barrier->arrive(runner_idx);
+    else              race.track->check_in(runner_idx);
+
+    uint64_t* recv = race.recv_ts + (size_t)runner_idx * race.ring;
+    uint64_t* send = race.send_ts + (size_t)runner_idx * race.ring;
+
+    for (int lap = 0; lap < race.laps; ++lap) {
+        race.track->wait_baton(runner_idx);
+        recv[(size_t)lap % race.ring] = race_tick(race);
+
+        if (race.verbose) {
+            printf("Runner %3d :: GO\n", runner_idx);
+            printf("Runner %3d :: DONE\n", runner_idx);
+        }
+
+        send[(size_t)lap % race.ring] = race_tick(race);
+        race.track->pass(runner_idx + 1);
+    }
 
     return EXIT_SUCCESS;
 }
 
-static int runner(int total_runners, int runner_idx, int queue_id) {
-    msg_t packet;
-    packet.mtype  = runner_idx + 1;
-    packet.status = STADIUM_STATUS_SPAWNED;
+#ifdef STADION_CORO
+// ------------------------------- Корутины -----------------------------------
+//
+// -m coro: судья и бегуны — корутины C++20, их выполняют несколько рабочих
+// потоков. У каждого потока своя очередь готовых корутин; пустой поток
+// ворует из чужих. Планировщик нужен только на старте: палочка передаётся
+// симметрично — передающий паркуется в своём слоте, а await_suspend
+// оставляет handle следующего в coro_next. Рабочий поток возобновляет его
+// в цикле (coro_run), без очередей и системных вызовов. Возврат handle из
+// await_suspend стек не растил бы только при хвостовом вызове, а его
+// компилятор делает лишь с оптимизацией; цикл от неё не зависит.
 
-    printf("Runner %3d :: hello -> judge\n", runner_idx);
-    if (msgsnd(queue_id, &packet, sizeof(packet), 0) == -1) {
-        perror("runner: msgsnd(hello)");
-        _exit(1);
+// Состояние слота: пусто, палочка пришла раньше бегуна, бегун ждёт палочку.
+enum baton_state_t : uint32_t {
+    BATON_EMPTY  = 0,
+    BATON_FULL   = 1,
+    BATON_PARKED = 2,
+};
+
+struct CoroSlot {
+    std::atomic<uint32_t>   state{BATON_EMPTY};
+    std::coroutine_handle<> waiter;
+};
+
+// Кого рабочий поток возобновит следующим; пусто — взять из очереди.
+static thread_local std::coroutine_handle<> coro_next;
+
+static void coro_run(std::coroutine_handle<> h) {
+    while (h) {
+        coro_next = nullptr;
+        h.resume();
+        h = coro_next;
+    }
+}
+
+class CoroScheduler {
+public:
+    explicit CoroScheduler(int workers) : queues_(new Queue[workers]), workers_(workers) {}
+    ~CoroScheduler() { delete[] queues_; }
+
+    // Раздача до start(): по очереди в каждую, без пробуждений.
+    void seed(std::coroutine_handle<> h) {
+        queues_[seeded_++ % workers_].tasks.push_back(h);
+        ready_.fetch_add(1, std::memory_order_relaxed);
     }
 
-    {
-        const long offset_base = total_runners + 1;
-        const long target_type = offset_base + runner_idx + 1;
-        if (msgrcv(queue_id, &packet, sizeof(packet), target_type, 0) == -1) {
-            perror("runner: msgrcv(wait-start)");
-            _exit(1);
+    void push(std::coroutine_handle<> h) {
+        {
+            std::lock_guard<std::mutex> guard(queues_[0].lock);
+            queues_[0].tasks.push_back(h);
+        }
+        ready_.fetch_add(1, std::memory_order_release);
+        ready_.notify_one();
+    }
+
+    void start(const Race& race) {
+        for (int w = 0; w < workers_; ++w) {
+            threads_.emplace_back([this, &race, w] {
+                pin_self(race, w + 1);
+                work(w);
+            });
+        }
+    }
+
+    void stop() {
+        stopping_.store(true, std::memory_order_release);
+        ready_.fetch_add(1, std::memory_order_release);
+        ready_.notify_all();
+        for (std::thread& t : threads_) t.join();
+    }
+
+private:
+    struct alignas(64) Queue {
+        std::mutex lock;
+        std::deque<std::coroutine_handle<>> tasks;
+    };
+
+    // Своя очередь — с хвоста (LIFO, горячий кэш), чужие — с головы.
+    bool take(int self, std::coroutine_handle<>& h) {
+        for (int i = 0; i < workers_; ++i) {
+            Queue& q = queues_[(self + i) % workers_];
+            std::lock_guard<std::mutex> guard(q.lock);
+            if (q.tasks.empty()) continue;
+            if (i == 0) { h = q.tasks.back();  q.tasks.pop_back();  }
+            else        { h = q.tasks.front(); q.tasks.pop_front(); }
+            ready_.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    void work(int self) {
+        std::coroutine_handle<> h;
+        for (;;) {
+            if (take(self, h)) {
+                coro_run(h);
+                continue;
+            }
+            if (stopping_.load(std::memory_order_acquire)) return;
+            int ready = ready_.load(std::memory_order_acquire);
+            if (ready <= 0) ready_.wait(ready);
+        }
+    }
+
+    Queue*                   queues_;
+    int                      workers_;
+    size_t                   seeded_ = 0;
+    std::atomic<int>         ready_{0};
+    std::atomic<bool>        stopping_{false};
+    std::vector<std::thread> threads_;
+};
+
+struct CoroRace {
+    Race&                 race;
+    CoroScheduler&        sched;
+    std::vector<CoroSlot> slots;      // 0 — не используется, N+1 — финиш у судьи
+    std::atomic<int>      arrived{0};
+    std::atomic<int>      done{0};
+
+    CoroRace(Race& r, CoroScheduler& s) : race(r), sched(s), slots((size_t)r.total_runners + 2) {}
+
+    // Встать в слот. false — палочка уже лежит, ждать не нужно.
+    bool park(int slot, std::coroutine_handle<> self) {
+        CoroSlot& s = slots[(size_t)slot];
+        s.waiter = self;
+        uint32_t expected = BATON_EMPTY;
+        if (s.state.compare_exchange_strong(expected, BATON_PARKED,
+                                            std::memory_order_acq_rel, std::memory_order_acquire)) {
+            return true;
+        }
+        s.state.store(BATON_EMPTY, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Положить палочку в слот; если там ждут — вернуть, кого возобновить,
+    // иначе пустой handle.
+    std::coroutine_handle<> hand_over(int slot) {
+        CoroSlot& s = slots[(size_t)slot];
+        if (s.state.exchange(BATON_FULL, std::memory_order_acq_rel) != BATON_PARKED) {
+            return nullptr;
+        }
+        std::coroutine_handle<> next = s.waiter;
+        s.state.store(BATON_EMPTY, std::memory_order_relaxed);
+        return next;
+    }
+};
+
+// co_await: встать в слот park_at и отдать палочку в pass_to (0 — никому).
+// check_in — первое ожидание бегуна: после парковки он отмечается у судьи.
+// Пока await_suspend работает, корутину уже может возобновить другой поток,
+// поэтому поля ожидателя (они в её кадре) читаются до парковки.
+struct BatonAwait {
+    CoroRace& cr;
+    int       park_at;
+    int       pass_to;
+    bool      check_in;
+
+    bool await_ready() const noexcept { return false; }
+    void await_resume() const noexcept {}
+
+    void await_suspend(std::coroutine_handle<> self) const noexcept {
+        CoroRace&  r      = cr;
+        const int  to     = pass_to;
+        const bool arrive = check_in;
+        const bool parked = r.park(park_at, self);
+
+        if (arrive && r.arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == r.race.total_runners) {
+            coro_next = r.hand_over(r.race.total_runners + 1);
+            return;
+        }
+        if (!to) {
+            if (!parked) coro_next = self;
+            return;
         }
+        // Палочка для нас уже пришла (с одной палочкой не бывает):
+        // себя — в очередь, на потоке продолжает следующий.
+        if (!parked) r.sched.push(self);
+        coro_next = r.hand_over(to);
     }
+};
+
+struct CoroTask {
+    struct promise_type;
+    using handle_t = std::coroutine_handle<promise_type>;
+
+    // Завершение: бегун отдаёт палочку дальше, судья будит main().
+    struct FinalHandOff {
+        bool await_ready() const noexcept { return false; }
+        void await_resume() const noexcept {}
+        void await_suspend(handle_t h) const noexcept {
+            CoroRace& r  = *h.promise().cr;
+            const int to = h.promise().pass_to;
+            if (to) {
+                coro_next = r.hand_over(to);
+                return;
+            }
+            r.done.store(1, std::memory_order_release);
+            r.done.notify_one();
+        }
+    };
+
+    struct promise_type {
+        CoroRace* cr;
+        int       pass_to;
+
+        // Параметры корутины доходят до конструктора обещания.
+        explicit promise_type(CoroRace& r) : cr(&r), pass_to(0) {}
+        promise_type(CoroRace& r, int runner_idx) : cr(&r), pass_to(runner_idx + 1) {}
+
+        CoroTask get_return_object() { return CoroTask{handle_t::from_promise(*this)}; }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        FinalHandOff final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+
+    handle_t handle;
+};
+
+static CoroTask coro_judge(CoroRace& cr) {
+    const Race& race   = cr.race;
+    const int   finish = race.total_runners + 1;
+
+    // Последний отметившийся бегун передаёт «палочку» в слот финиша.
+    co_await BatonAwait{cr, finish, 0, false};
+    race.phase_ns[2] = now_ns();
+    puts("Judge >>> everyone is on the track");
+    fflush(stdout);
 
-    if (packet.status != STADIUM_STATUS_ADVANCE) {
-        fprintf(stderr, "Runner %d :: unexpected status = %d\n", runner_idx, packet.status);
+    struct timeval t_begin;
+    if (gettimeofday(&t_begin, NULL) != 0) {
+        perror("judge: gettimeofday(start)");
         _exit(1);
     }
 
-    printf("Runner %3d :: GO\n", runner_idx);
-    printf("Runner %3d :: DONE\n", runner_idx);
+    uint64_t* start_send  = race.send_ts;
+    uint64_t* finish_recv = race.recv_ts + (size_t)finish * race.ring;
 
-    {
-        const long offset_base = total_runners + 1;
-        packet.mtype  = offset_base + runner_idx + 2;
-        packet.status = STADIUM_STATUS_ADVANCE;
-        if (msgsnd(queue_id, &packet, sizeof(stadium_status_t), 0) == -1) {
-            perror("runner: msgsnd(next)");
-            _exit(1);
+    for (int lap = 0; lap < race.laps; ++lap) {
+        start_send[(size_t)lap % race.ring] = race_tick(race);
+        co_await BatonAwait{cr, finish, 1, false};
+        finish_recv[(size_t)lap % race.ring] = race_tick(race);
+    }
+
+    judge_results(race, t_begin);
+}
+
+static CoroTask coro_runner(CoroRace& cr, int runner_idx) {
+    const Race& race = cr.race;
+    if (race.verbose) {
+        printf("Runner %3d :: hello -> judge\n", runner_idx);
+    }
+    co_await BatonAwait{cr, runner_idx, 0, true};
+
+    uint64_t* recv = race.recv_ts + (size_t)runner_idx * race.ring;
+    uint64_t* send = race.send_ts + (size_t)runner_idx * race.ring;
+
+    for (int lap = 0; ; ++lap) {
+        recv[(size_t)lap % race.ring] = race_tick(race);
+
+        if (race.verbose) {
+            printf("Runner %3d :: GO\n", runner_idx);
+            printf("Runner %3d :: DONE\n", runner_idx);
         }
+
+        send[(size_t)lap % race.ring] = race_tick(race);
+        if (lap + 1 == race.laps) break;
+        co_await BatonAwait{cr, runner_idx, runner_idx + 1, false};
     }
+    // Последний круг: палочку передаёт FinalHandOff.
+}
 
-    return EXIT_SUCCESS;
-}
\ No newline at end of file
+static void coro_race(Race& race, int workers) {
+    CoroScheduler sched(workers);
+    CoroRace      cr(race, sched);
+
+    printf("Judge >>> init (coroutines, %d worker threads)\n", workers);
+    fflush(stdout);
+
+    std::vector<CoroTask::handle_t> frames;
+    frames.reserve((size_t)race.total_runners + 1);
+
+    race.phase_ns[0] = now_ns();
+    frames.push_back(coro_judge(cr).handle);
+    for (int idx = 1; idx <= race.total_runners; ++idx) {
+        frames.push_back(coro_runner(cr, idx).handle);
+    }
+    for (CoroTask::handle_t h : frames) sched.seed(h);
+    sched.start(race);
+    race.phase_ns[1] = now_ns();
+
+    while (!cr.done.load(std::memory_order_acquire)) cr.done.wait(0);
+    sched.stop();
+
+    // Все корутины стоят на final_suspend.
+    for (CoroTask::handle_t h : frames) h.destroy();
+}
+#endif
+
+// Задержка перехода slot-1 -> slot: от отправки до получения палочки.
+// Судья — слот 0 на старте и слот N+1 на финише. В кольце — последние
+// ring кругов.
+static void report_hops(const Race& race) {
+    const int    n     = race.total_runners;
+    const size_t ring  = race.ring;
+    const size_t first = (size_t)race.laps - ring;
+
+    FILE* dump = nullptr;
+    if (race.dump_path) {
+        dump = fopen(race.dump_path, "w");
+        if (!dump) perror(race.dump_path);
+    }
+
+    std::vector<uint64_t> hops;
+    hops.reserve((size_t)(n + 1) * ring);
+    for (int slot = 1; slot <= n + 1; ++slot) {
+        for (size_t lap = first; lap < (size_t)race.laps; ++lap) {
+            uint64_t sent = race.send_ts[(size_t)(slot - 1) * ring + lap % ring];
+            uint64_t got  = race.recv_ts[(size_t)slot * ring + lap % ring];
+            uint64_t ns   = got > sent ? (uint64_t)((double)(got - sent) * race.ns_per_tick) : 0;
+            hops.push_back(ns);
+            if (dump) fprintf(dump, "%zu %d %llu\n", lap, slot, (unsigned long long)ns);
+        }
+    }
+    if (dump) fclose(dump);
+    std::sort(hops.begin(), hops.end());
+
+    auto pct = [&](double p) {
+        size_t i = (size_t)(p * (double)(hops.size() - 1) + 0.5);
+        return (double)hops[i] / 1.0e3;
+    };
+    double sum = 0;
+    for (uint64_t h : hops) sum += (double)h;
+
+    printf("hop latency, us (%s, %zu hops): min %.3f  p50 %.3f  p99 %.3f  p99.9 %.3f  max %.3f  mean %.3f\n",
+           track_name(race), hops.size(), pct(0.0), pct(0.50), pct(0.99), pct(0.999),
+           pct(1.0), sum / (double)hops.size() / 1.0e3);
+
+    // Гистограмма по степеням двойки (нс).
+    size_t bucket_count[64] = {};
+    for (uint64_t h : hops) {
+        int b = h ? 63 - __builtin_clzll(h) : 0;
+        ++bucket_count[b];
+    }
+    for (int b = 0; b < 64; ++b) {
+        if (!bucket_count[b]) continue;
+        double share = 100.0 * (double)bucket_count[b] / (double)hops.size();
+        printf("  [%9llu, %9llu) ns %10zu %6.2f%% ", 1ull << b, 2ull << b, bucket_count[b], share);
+        for (int i = 0; i < (int)(share / 2); ++i) putchar('#');
+        putchar('\n');
+    }
+}
@@ -2,15 +2,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
 #include <mqueue.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
+#include <linux/futex.h>
 #include <time.h>
 
+#include "tsc_clock.h"
+
 static inline bool is_child_process(pid_t p) { return p == 0; }
 
 static pid_t Fork(void) {
@@ -30,8 +36,126 @@ struct msg_t {
     enum stadium_status_t status;
 };
 
-static int runner(int total_runners, int runner_idx, mqd_t q_checkin, mqd_t *baton);
-static int judge (int total_runners, mqd_t q_checkin, mqd_t *baton);
+// Палочка в режиме -f: futex-слово на отдельной кэш-линии.
+struct futex_word {
+    uint32_t v;
+    char     pad[64 - sizeof(uint32_t)];
+} __attribute__((aligned(64)));
+
+// Беговая дорожка: либо N+1 очередей POSIX (по умолчанию), либо одна общая
+// область MAP_SHARED с futex-словами — тогда число объектов ядра не
+// зависит от N и не упирается в queues_max / RLIMIT_MSGQUEUE.
+struct track_t {
+    bool               futex_mode;
+    mqd_t              q_checkin;
+    mqd_t             *baton;
+    struct futex_word *words;    // [0] — счётчик check-in, [1..N+1] — палочки
+};
+
+// Режим -T: вместо printf на каждом переходе участники пишут отметки
+// времени (тики TSC или нс CLOCK_MONOTONIC_RAW) в заранее выделенную
+// общую область, по кэш-линии на слот. Судья разбирает их после забега.
+struct trace_slot {
+    uint64_t recv;
+    uint64_t send;
+    char     pad[64 - 2 * sizeof(uint64_t)];
+} __attribute__((aligned(64)));
+
+struct trace_t {
+    bool               on;
+    bool               use_tsc;
+    double             ns_per_tick;
+    const char        *dump_path;
+    struct trace_slot *slots;    // [0] — старт судьи, [1..N] — бегуны, [N+1] — финиш
+};
+
+static struct trace_t trace;
+
+static inline uint64_t trace_tick(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (trace.use_tsc) return __rdtsc();
+#endif
+    return raw_ns();
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Задержка перехода s-1 -> s: от отправки до получения палочки.
+static void trace_report(int total_runners) {
+    size_t    hops = (size_t)total_runners + 1;
+    uint64_t *ns   = (uint64_t*)calloc(hops, sizeof(uint64_t));
+    if (!ns) { perror("calloc trace"); return; }
+
+    FILE *dump = NULL;
+    if (trace.dump_path) {
+        dump = fopen(trace.dump_path, "w");
+        if (!dump) perror(trace.dump_path);
+    }
+
+    for (size_t s = 1; s <= hops; ++s) {
+        uint64_t sent = trace.slots[s - 1].send;
+        uint64_t got  = trace.slots[s].recv;
+        ns[s - 1] = got > sent ? (uint64_t)((double)(got - sent) * trace.ns_per_tick) : 0;
+        if (dump) fprintf(dump, "%zu %llu\n", s, (unsigned long long)ns[s - 1]);
+    }
+    if (dump) fclose(dump);
+
+    qsort(ns, hops, sizeof(uint64_t), cmp_u64);
+    double sum = 0;
+    for (size_t i = 0; i < hops; ++i) sum += (double)ns[i];
+
+    printf("Judge >>> hop latency, us (%zu hops): min %.3f  p50 %.3f  p99 %.3f  max %.3f  mean %.3f\n",
+           hops, ns[0] / 1e3, ns[hops / 2] / 1e3, ns[(size_t)(0.99 * (double)(hops - 1))] / 1e3,
+           ns[hops - 1] / 1e3, sum / (double)hops / 1e3);
+    free(ns);
+}
+
+static int runner(int total_runners, int runner_idx, struct track_t *track);
+static int judge (int total_runners, struct track_t *track);
+
+static long futex(uint32_t *word, int op, uint32_t val) {
+    return syscall(SYS_futex, word, op, val, NULL, NULL, 0);
+}
+
+static void baton_pass(struct track_t *track, int slot, const char *what) {
+    if (track->futex_mode) {
+        __atomic_store_n(&track->words[slot].v, 1, __ATOMIC_RELEASE);
+        futex(&track->words[slot].v, FUTEX_WAKE, 1);
+        return;
+    }
+
+    struct msg_t msg;
+    msg.runner_idx = slot - 1;
+    msg.status = STADIUM_STATUS_ADVANCE;
+    if (mq_send(track->baton[slot], (const char*)&msg, sizeof(msg), 0) != 0) {
+        perror(what);
+        _exit(1);
+    }
+}
+
+static void baton_wait(struct track_t *track, int slot, const char *what) {
+    if (track->futex_mode) {
+        uint32_t *w = &track->words[slot].v;
+        while (__atomic_load_n(w, __ATOMIC_ACQUIRE) == 0) {
+            if (futex(w, FUTEX_WAIT, 0) != 0 && errno != EAGAIN && errno != EINTR) {
+                perror(what);
+                _exit(1);
+            }
+        }
+        return;
+    }
+
+    struct msg_t msg;
+    ssize_t got = mq_receive(track->baton[slot], (char*)&msg, sizeof(msg), NULL);
+    if (got < 0) { perror(what); _exit(1); }
+    if (msg.status != STADIUM_STATUS_ADVANCE) {
+        fprintf(stderr, "slot %d :: unexpected status = %d\n", slot, msg.status);
+        _exit(1);
+    }
+}
 
 static mqd_t mq_create_open(const char *name, long maxmsg, long msgsize) {
     struct mq_attr attr = {0};
@@ -47,11 +171,26 @@ static mqd_t mq_create_open(const char *name, long maxmsg, long msgsize) {
 }
 
 int main(int ac, char *av[]) {
-    if (ac != 2) {
+    struct track_t track = {};
+
+    int opt;
+    while ((opt = getopt(ac, av, "fTo:")) != -1) {
+        if (opt == 'f') {
+            track.futex_mode = true;
+        } else if (opt == 'T') {
+            trace.on = true;
+        } else if (opt == 'o') {
+            trace.dump_path = optarg;
+        } else {
+            fprintf(stderr, "usage: %s [-f] [-T [-o file]] N\n", av[0]);
+            _exit(1);
+        }
+    }
+    if (optind + 1 != ac) {
         fprintf(stderr, "ERROR, YOU SHOULD ENTER N RUNNERS\n");
         _exit(1);
     }
-    int n = atoi(av[1]);
+    int n = atoi(av[optind]);
     if (n <= 0) {
         fprintf(stderr, "N must be positive\n");
         _exit(1);
@@ -59,35 +198,56 @@ int main(int ac, char *av[]) {
 
     pid_t mypid = getpid();
     char q_checkin_name[64];
-    snprintf(q_checkin_name, sizeof(q_checkin_name), "/checkin_%ld", (long)mypid);
+    char **baton_names = NULL;
+    size_t words_size = (size_t)(n + 2) * sizeof(struct futex_word);
+
+    if (track.futex_mode) {
+        void *p = mmap(NULL, words_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) { perror("mmap batons"); _exit(1); }
+        track.words = (struct futex_word*)p;
+    } else {
+        snprintf(q_checkin_name, sizeof(q_checkin_name), "/checkin_%ld", (long)mypid);
+
+        baton_names = (char**)calloc((size_t)(n + 2), sizeof(char*));
+        if (!baton_names) { perror("calloc baton_names"); _exit(1); }
+        for (int i = 1; i <= n + 1; ++i) {
+            baton_names[i] = (char*)calloc(64, sizeof(char));
+            if (!baton_names[i]) { perror("calloc baton_names[i]"); _exit(1); }
+            snprintf(baton_names[i], 64, "/baton_%ld_%d", (long)mypid, i);
+        }
 
-    char **baton_names = (char**)calloc((size_t)(n + 2), sizeof(char*));
-    if (!baton_names) { perror("calloc baton_names"); _exit(1); }
-    for (int i = 1; i <= n + 1; ++i) {
-        baton_names[i] = (char*)calloc(64, sizeof(char));
-        if (!baton_names[i]) { perror("calloc baton_names[i]"); _exit(1); }
-        snprintf(baton_names[i], 64, "/baton_%ld_%d", (long)mypid, i);
-    }
+        const long MSGSZ = (long)sizeof(struct msg_t);
 
-    const long MSGSZ = (long)sizeof(struct msg_t);
+        track.q_checkin = mq_create_open(q_checkin_name, (n > 10 ? n : 10), MSGSZ);
 
-    mqd_t q_checkin = mq_create_open(q_checkin_name, (n > 10 ? n : 10), MSGSZ);
+        track.baton = (mqd_t*)calloc((size_t)(n + 2), sizeof(mqd_t));
+        if (!track.baton) { perror("calloc baton"); _exit(1); }
+        for (int i = 1; i <= n + 1; ++i) {
+            track.baton[i] = mq_create_open(baton_names[i], 10, MSGSZ);
+        }
+    }
 
-    mqd_t *baton = (mqd_t*)calloc((size_t)(n + 2), sizeof(mqd_t));
-    if (!baton) { perror("calloc baton"); _exit(1); }
-    for (int i = 1; i <= n + 1; ++i) {
-        baton[i] = mq_create_open(baton_names[i], 10, MSGSZ);
+    size_t trace_size = (size_t)(n + 2) * sizeof(struct trace_slot);
+    if (trace.on) {
+        void *p = mmap(NULL, trace_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) { perror("mmap trace"); _exit(1); }
+        trace.slots       = (struct trace_slot*)p;
+        trace.use_tsc     = tsc_usable();
+        trace.ns_per_tick = trace.use_tsc ? calibrate_tsc() : 1.0;
+        if (trace.use_tsc) printf("trace: TSC, %.4f ns/tick\n", trace.ns_per_tick);
+        else               printf("trace: CLOCK_MONOTONIC_RAW (no invariant TSC)\n");
+        fflush(stdout);
     }
 
     pid_t arbiter = Fork();
     if (is_child_process(arbiter)) {
-        return judge(n, q_checkin, baton);
+        return judge(n, &track);
     }
 
     for (int i = 1; i <= n; ++i) {
         pid_t r = Fork();
         if (is_child_process(r)) {
-            return runner(n, i, q_checkin, baton);
+            return runner(n, i, &track);
         }
     }
 
@@ -95,79 +255,97 @@ int main(int ac, char *av[]) {
         (void)wait(NULL);
     }
 
-    mq_close(q_checkin);
+    if (trace.on) {
+        munmap(trace.slots, trace_size);
+    }
+
+    if (track.futex_mode) {
+        munmap(track.words, words_size);
+        return 0;
+    }
+
+    mq_close(track.q_checkin);
     mq_unlink(q_checkin_name);
     for (int i = 1; i <= n + 1; ++i) {
-        mq_close(baton[i]);
+        mq_close(track.baton[i]);
         mq_unlink(baton_names[i]);
         free(baton_names[i]);
     }
     free(baton_names);
-    free(baton);
+    free(track.baton);
 
     return 0;
 }
 
-static int judge(int total_runners, mqd_t q_checkin, mqd_t *baton) {
+static int judge(int total_runners, struct track_t *track) {
     struct msg_t msg;
     printf("Judge >>> init\n");
 
-    for (int i = 0; i < total_runners; ++i) {
-        ssize_t got = mq_receive(q_checkin, (char*)&msg, sizeof(msg), NULL);
-        if (got < 0) { perror("judge: mq_receive(checkin)"); _exit(1); }
-        printf("Judge >>> check-in by runner idx=%d\n", msg.runner_idx);
+    if (track->futex_mode) {
+        // Будит судью только последний отметившийся бегун.
+        uint32_t *arrived = &track->words[0].v;
+        uint32_t  seen;
+        while ((seen = __atomic_load_n(arrived, __ATOMIC_ACQUIRE)) != (uint32_t)total_runners) {
+            futex(arrived, FUTEX_WAIT, seen);
+        }
+        printf("Judge >>> check-in by all %d runners\n", total_runners);
+    } else {
+        for (int i = 0; i < total_runners; ++i) {
+            ssize_t got = mq_receive(track->q_checkin, (char*)&msg, sizeof(msg), NULL);
+            if (got < 0) { perror("judge: mq_receive(checkin)"); _exit(1); }
+            if (!trace.on) printf("Judge >>> check-in by runner idx=%d\n", msg.runner_idx);
+        }
     }
     puts("Judge >>> everyone is on the track");
+    fflush(stdout);
 
     struct timespec t0, t1;
     if (clock_gettime(CLOCK_MONOTONIC, &t0) != 0) { perror("judge: clock_gettime(start)"); _exit(1); }
 
-    msg.runner_idx = 0;
-    msg.status = STADIUM_STATUS_ADVANCE;
-    if (mq_send(baton[1], (const char*)&msg, sizeof(msg), 0) != 0) {
-        perror("judge: mq_send(start-first)");
-        _exit(1);
-    }
-
-    ssize_t got = mq_receive(baton[total_runners + 1], (char*)&msg, sizeof(msg), NULL);
-    if (got < 0) { perror("judge: mq_receive(last-finish)"); _exit(1); }
+    if (trace.on) trace.slots[0].send = trace_tick();
+    baton_pass(track, 1, "judge: send(start-first)");
+    baton_wait(track, total_runners + 1, "judge: receive(last-finish)");
+    if (trace.on) trace.slots[total_runners + 1].recv = trace_tick();
 
     if (clock_gettime(CLOCK_MONOTONIC, &t1) != 0) { perror("judge: clock_gettime(end)"); _exit(1); }
 
     double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
     printf("Judge >>> elapsed: %.3f ms\n", ms);
 
+    // Финишная палочка пришла после всех записей бегунов.
+    if (trace.on) {
+        trace_report(total_runners);
+    }
+
     return EXIT_SUCCESS;
 }
 
-static int runner(int total_runners, int runner_idx, mqd_t q_checkin, mqd_t *baton) {
-    (void)total_runners;
-
+static int runner(int total_runners, int runner_idx, struct track_t *track) {
     struct msg_t msg;
     msg.runner_idx = runner_idx;
     msg.status = STADIUM_STATUS_SPAWNED;
-    printf("Runner %3d :: hello -> judge\n", runner_idx);
-    if (mq_send(q_checkin, (const char*)&msg, sizeof(msg), 0) != 0) {
+    if (!trace.on) printf("Runner %3d :: hello -> judge\n", runner_idx);
+    if (track->futex_mode) {
+        uint32_t *arrived = &track->words[0].v;
+        if (__atomic_add_fetch(arrived, 1, __ATOMIC_ACQ_REL) == (uint32_t)total_runners) {
+            futex(arrived, FUTEX_WAKE, 1);
+        }
+    } else if (mq_send(track->q_checkin, (const char*)&msg, sizeof(msg), 0) != 0) {
         perror("runner: mq_send(hello)");
         _exit(1);
     }
 
-    ssize_t got = mq_receive(baton[runner_idx], (char*)&msg, sizeof(msg), NULL);
-    if (got < 0) { perror("runner: mq_receive(wait-start)"); _exit(1); }
-    if (msg.status != STADIUM_STATUS_ADVANCE) {
-        fprintf(stderr, "Runner %d :: unexpected status = %d\n", runner_idx, msg.status);
-        _exit(1);
-    }
-
-    printf("Runner %3d :: GO\n", runner_idx);
-    printf("Runner %3d :: DONE\n", runner_idx);
+    baton_wait(track, runner_idx, "runner: receive(wait-start)");
 
-    msg.runner_idx = runner_idx;
-    msg.status = STADIUM_STATUS_ADVANCE;
-    if (mq_send(baton[runner_idx + 1], (const char*)&msg, sizeof(msg), 0) != 0) {
-        perror("runner: mq_send(next)");
-        _exit(1);
+    if (trace.on) {
+        trace.slots[runner_idx].recv = trace_tick();
+        trace.slots[runner_idx].send = trace_tick();
+    } else {
+        printf("Runner %3d :: GO\n", runner_idx);
+        printf("Runner %3d :: DONE\n", runner_idx);
     }
 
+    baton_pass(track, runner_idx + 1, "runner: send(next)");
+
     return EXIT_SUCCESS;
 }
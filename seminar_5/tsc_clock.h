@@ -0,0 +1,55 @@
+// Часы трассировки стадиона (режим -T) — общие для stadion.cpp и
+// stadion_posix.cpp: тики инвариантного TSC или наносекунды
+// CLOCK_MONOTONIC_RAW, если TSC не годится.
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+static inline uint64_t raw_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// TSC годится, только если он инвариантный (constant_tsc + nonstop_tsc):
+// тогда он идёт с постоянной частотой и согласован между ядрами.
+static inline bool tsc_usable(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    FILE* f = fopen("/proc/cpuinfo", "r");
+    if (!f) return false;
+    char line[4096];
+    bool constant = false, nonstop = false;
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "flags", 5) != 0) continue;
+        constant = strstr(line, " constant_tsc") != NULL;
+        nonstop  = strstr(line, " nonstop_tsc")  != NULL;
+        break;
+    }
+    fclose(f);
+    return constant && nonstop;
+#else
+    return false;
+#endif
+}
+
+// Один раз на старте: сколько наносекунд CLOCK_MONOTONIC_RAW в одном тике TSC.
+static inline double calibrate_tsc(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t ns0  = raw_ns();
+    uint64_t tsc0 = __rdtsc();
+    while (raw_ns() - ns0 < 50 * 1000 * 1000) {
+    }
+    uint64_t ns1  = raw_ns();
+    uint64_t tsc1 = __rdtsc();
+    return (double)(ns1 - ns0) / (double)(tsc1 - tsc0);
+#else
+    return 1.0;
+#endif
+}
@@ -0,0 +1,32 @@
+#!/bin/sh
+# Пропускная способность семафоров душевой: набор SysV (semop на каждую
+# P()/V()) против futex-семафоров в сегменте Shared, от 1 до 64 процессов.
+#
+#   ./bench_shower_sem.sh [slots] [rounds]
+#
+# Список числа процессов можно переопределить: PROCS="2 8" ./bench_shower_sem.sh
+
+set -eu
+
+SLOTS=${1:-4}
+ROUNDS=${2:-2000}
+DIR=$(cd "$(dirname "$0")" && pwd)
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+c++ -std=c++17 -O2 -o "$TMP/shower" "$DIR/shower.cpp"
+
+ops_per_sec() {
+    "$TMP/shower" -q -s "$1" -r "$ROUNDS" "$SLOTS" "$2" "$3" |
+        sed -n 's/.* ms, \([0-9]*\) ops\/sec.*/\1/p'
+}
+
+printf "%6s  %14s  %14s  %8s\n" "procs" "sysv ops/s" "futex ops/s" "speedup"
+for p in ${PROCS:-1 2 4 8 16 32 64}; do
+    men=$(( (p + 1) / 2 ))
+    women=$(( p - men ))
+    s=$(ops_per_sec sysv "$men" "$women")
+    f=$(ops_per_sec futex "$men" "$women")
+    printf "%6s  %14s  %14s  %8s\n" "$p" "$s" "$f" \
+        "$(awk -v s="$s" -v f="$f" 'BEGIN { if (s > 0) printf "%.1fx", f / s; else print "-" }')"
+done
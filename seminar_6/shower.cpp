@@ -1,15 +1,22 @@
 #include <cerrno>
+#include <cmath>
 #include <csignal>
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <cstdint>
 #include <unistd.h>
+#include <linux/futex.h>
 #include <sys/types.h>
 #include <sys/ipc.h>
 #include <sys/sem.h>
 #include <sys/shm.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 
 #define RESET   "\033[0m"
@@ -25,9 +32,19 @@ enum {
     S_SLOTS   = 3,   // счётный: свободные места (N)
     S_MEN_MTX = 4,   // мьютекс счётчика мужчин
     S_WOM_MTX = 5,   // мьютекс счётчика женщин
+    S_BATCH_MTX  = 6,   // -p batch: мьютекс состояния Batch
+    S_MEN_GATE   = 7,   // -p batch: пропуска, выданные ждущим мужчинам
+    S_WOM_GATE   = 8,   // -p batch: пропуска, выданные ждущим женщинам
     S_COUNT
 };
 
+enum gender_t { MAN = 0, WOMAN = 1 };
+
+// Политика допуска: room — первый вошедший пол держит комнату, пока внутри
+// есть хоть кто-то (другой пол может ждать бесконечно); batch — полы
+// чередуются партиями ограниченного размера.
+enum policy_t { POLICY_ROOM, POLICY_BATCH };
+
 union semun {
     int val;
     struct sem_id_ds *buf;
@@ -54,21 +71,129 @@ static void die(const char* fmt, ...) {
     std::exit(EXIT_FAILURE);
 }
 
-static void sem_change(int sem_id, unsigned short idx, short delta) {
-    sembuf op{ idx, delta, 0 };
-    while (semop(sem_id, &op, 1) == -1) {
-        if (errno == EINTR) continue;
-        die("semop failed (idx=%hu, delta=%d): %s", idx, (int)delta, strerror(errno));
+// Семафор в разделяемой памяти: захват и освобождение без системных
+// вызовов, пока нет конкуренции. Ждущий процесс засыпает на value через
+// FUTEX_WAIT, V() делает FUTEX_WAKE, только если кто-то ждёт.
+// Сегмент shm общий для процессов, поэтому futex без FUTEX_PRIVATE_FLAG.
+struct FutexSem {
+    std::atomic<int> value;
+    std::atomic<int> waiters;
+};
+
+static long futex(std::atomic<int>* word, int op, int val) {
+    return syscall(SYS_futex, reinterpret_cast<int*>(word), op, val, nullptr, nullptr, 0);
+}
+
+static void fsem_P(FutexSem* sem) {
+    int v = sem->value.load(std::memory_order_relaxed);
+    for (;;) {
+        while (v > 0) {
+            if (sem->value.compare_exchange_weak(v, v - 1, std::memory_order_acquire,
+                                                 std::memory_order_relaxed)) {
+                return;
+            }
+        }
+        // waiters увеличивается до повторной проверки value, а V() читает
+        // waiters после увеличения value — пробуждение не теряется.
+        sem->waiters.fetch_add(1, std::memory_order_seq_cst);
+        if (sem->value.load(std::memory_order_seq_cst) == 0 &&
+            futex(&sem->value, FUTEX_WAIT, 0) == -1 && errno != EAGAIN && errno != EINTR) {
+            die("futex wait failed: %s", strerror(errno));
+        }
+        sem->waiters.fetch_sub(1, std::memory_order_relaxed);
+        v = sem->value.load(std::memory_order_relaxed);
+    }
+}
+
+static void fsem_V(FutexSem* sem) {
+    sem->value.fetch_add(1, std::memory_order_seq_cst);
+    if (sem->waiters.load(std::memory_order_seq_cst) > 0 &&
+        futex(&sem->value, FUTEX_WAKE, 1) == -1) {
+        die("futex wake failed: %s", strerror(errno));
     }
 }
-static inline void P(int sem_id, unsigned short idx) { sem_change(sem_id, idx, -1); }
-static inline void V(int sem_id, unsigned short idx) { sem_change(sem_id, idx, +1); }
+
+// Состояние партий, под S_BATCH_MTX. Текущий пол cur получает пропуска,
+// пока в партии есть место (admitted < limit) и свободны места в душе.
+// Если другой пол ждёт, после limit допусков новых не будет: как только
+// последний из партии выйдет, очередь переходит к другому полу.
+struct Batch {
+    int waiting[2];   // ждут пропуска
+    int inside[2];    // получили пропуск и ещё не вышли
+    int cur;          // пол текущей партии, -1 — очередь ничья
+    int last;         // пол последней партии
+    int admitted;     // допущено в текущей партии
+    int limit;        // размер текущей партии
+    int batch;        // -b: фиксированный размер, 0 — по длине очереди
+    int slots;        // N
+};
+
+// Журнал визитов (отдельный сегмент shm): каждый процесс пишет только в
+// свои K записей, без блокировок и stdio. Разбирает родитель после wait().
+struct VisitRec {
+    uint64_t arrive;   // пришёл к душу (нс, CLOCK_MONOTONIC)
+    uint64_t admit;    // получил место
+    uint64_t leave;    // освободил место
+};
+
+enum dist_t { DIST_FIXED, DIST_EXP, DIST_UNIFORM };
+
+// Нагрузка: K визитов на человека, паузы между ними и время в душе.
+struct Workload {
+    int      visits;        // -r: K
+    double   arrival_rate;  // -a: визитов в секунду на человека, 0 — без пауз
+    int      service_us;    // -t: среднее время в душе
+    dist_t   service_dist;  // -d
+    unsigned seed;          // -S
+};
 
 struct Shared {
     int men_in;    
     int women_in;  
+    FutexSem sem[S_COUNT];           // -s futex: те же семафоры, что и в наборе SysV
+    std::atomic<unsigned long> ops;  // число P()/V() всех процессов, для отчёта
+    Batch batch;
 };
 
+// Откуда берутся семафоры: набор SysV (semop на каждую операцию)
+// или FutexSem в сегменте Shared.
+struct Sync {
+    int       sem_id;   // -1, если семафоры futex
+    FutexSem* fsem;
+};
+
+// Операции текущего процесса; сбрасываются в Shared::ops при выходе.
+static unsigned long sem_ops = 0;
+// -q: без сообщений о входе и выходе (для замеров).
+static bool verbose = true;
+static policy_t policy = POLICY_ROOM;
+
+static void sem_change(const Sync& sync, unsigned short idx, short delta) {
+    ++sem_ops;
+    if (sync.fsem) {
+        if (delta < 0) fsem_P(&sync.fsem[idx]);
+        else           fsem_V(&sync.fsem[idx]);
+        return;
+    }
+    sembuf op{ idx, delta, 0 };
+    while (semop(sync.sem_id, &op, 1) == -1) {
+        if (errno == EINTR) continue;
+        die("semop failed (idx=%hu, delta=%d): %s", idx, (int)delta, strerror(errno));
+    }
+}
+static inline void P(const Sync& sync, unsigned short idx) { sem_change(sync, idx, -1); }
+static inline void V(const Sync& sync, unsigned short idx) { sem_change(sync, idx, +1); }
+
+// Начальные значения одинаковы для обоих вариантов.
+static int sem_initial(int idx, int N) {
+    switch (idx) {
+        case S_ROOM: case S_MEN_MTX: case S_WOM_MTX:
+        case S_BATCH_MTX:                            return 1;
+        case S_SLOTS:                                return N;
+        default:                                     return 0;
+    }
+}
+
 static int create_semset(int N) {
     int sem_id = semget(IPC_PRIVATE, S_COUNT, IPC_CREAT | 0600);
     if (sem_id == -1) die("semget failed: %s", std::strerror(errno));
@@ -79,6 +204,9 @@ static int create_semset(int N) {
     arg.val = N; if (semctl(sem_id, S_SLOTS,   SETVAL, arg) == -1) die("semctl SLOTS: %s",   std::strerror(errno));
     arg.val = 1; if (semctl(sem_id, S_MEN_MTX, SETVAL, arg) == -1) die("semctl MEN_MTX: %s", std::strerror(errno));
     arg.val = 1; if (semctl(sem_id, S_WOM_MTX, SETVAL, arg) == -1) die("semctl WOM_MTX: %s", std::strerror(errno));
+    arg.val = 1; if (semctl(sem_id, S_BATCH_MTX, SETVAL, arg) == -1) die("semctl BATCH_MTX: %s", std::strerror(errno));
+    arg.val = 0; if (semctl(sem_id, S_MEN_GATE,  SETVAL, arg) == -1) die("semctl MEN_GATE: %s",  std::strerror(errno));
+    arg.val = 0; if (semctl(sem_id, S_WOM_GATE,  SETVAL, arg) == -1) die("semctl WOM_GATE: %s",  std::strerror(errno));
     return sem_id;
 }
 
@@ -90,142 +218,438 @@ static int create_shm(Shared** out) {
     *out = (Shared*)p;
     (*out)->men_in = 0;
     (*out)->women_in = 0;
+    (*out)->ops.store(0);
+    memset(&(*out)->batch, 0, sizeof(Batch));
+    (*out)->batch.cur = -1;
     return shared_memory_id;
 }
 
+static void init_futex_sems(Shared* sh, int N) {
+    for (int i = 0; i < S_COUNT; ++i) {
+        sh->sem[i].value.store(sem_initial(i, N));
+        sh->sem[i].waiters.store(0);
+    }
+}
+
 static void cleanup_ipc(int sem_id, int shared_memory_id, Shared* sh) {
     if (sh && sh != (void*)-1)  shmdt(sh);
     if (shared_memory_id != -1) shmctl(shared_memory_id, IPC_RMID, nullptr);
     if (sem_id != -1)           semctl(sem_id, 0, IPC_RMID);
 }
 
-static void man_enter(int sem_id, Shared* sh, int id) {
+static void man_enter(const Sync& sync, Shared* sh, int id) {
     // первый мужчина закрывает комнату
-    P(sem_id, S_MEN_MTX);
+    P(sync, S_MEN_MTX);
 
     // create critical section ..
 
     sh->men_in++;
     if (sh->men_in == 1) {
-        P(sem_id, S_ROOM); // заняли душ для мужчин
+        P(sync, S_ROOM); // заняли душ для мужчин
     }
 
     // exit of section ..
 
-    V(sem_id, S_MEN_MTX);
+    V(sync, S_MEN_MTX);
 
     // дождаться свободного места
-    P(sem_id, S_SLOTS);
-    printf(BLUE "МУЖЧИНА НОМЕР %d ЗАШЕЛ В ДУШ\n" RESET, id);
-    fflush(stdout);
+    P(sync, S_SLOTS);
+    if (verbose) {
+        printf(BLUE "МУЖЧИНА НОМЕР %d ЗАШЕЛ В ДУШ\n" RESET, id);
+        fflush(stdout);
+    }
 }
 
-static void man_leave(int sem_id, Shared* sh, int id) {
-    printf(BLUE "МУЖЧИНА НОМЕР %d ВЫШЕЛ ИЗ ДУША\n" RESET, id);
-    fflush(stdout);
+static void man_leave(const Sync& sync, Shared* sh, int id) {
+    if (verbose) {
+        printf(BLUE "МУЖЧИНА НОМЕР %d ВЫШЕЛ ИЗ ДУША\n" RESET, id);
+        fflush(stdout);
+    }
 
-    V(sem_id, S_SLOTS);
+    V(sync, S_SLOTS);
 
-    P(sem_id, S_MEN_MTX);
+    P(sync, S_MEN_MTX);
     sh->men_in--;
     if (sh->men_in == 0) {
-        V(sem_id, S_ROOM); // открыли душ для другого пола
+        V(sync, S_ROOM); // открыли душ для другого пола
     }
-    V(sem_id, S_MEN_MTX);
+    V(sync, S_MEN_MTX);
 }
 
-static void woman_enter(int sem_id, Shared* sh, int id) {
-    P(sem_id, S_WOM_MTX);
+static void woman_enter(const Sync& sync, Shared* sh, int id) {
+    P(sync, S_WOM_MTX);
     sh->women_in++;
     if (sh->women_in == 1) {
-        P(sem_id, S_ROOM);
+        P(sync, S_ROOM);
     }
-    V(sem_id, S_WOM_MTX);
+    V(sync, S_WOM_MTX);
 
-    P(sem_id, S_SLOTS);
-    printf(MANG "ЖЕНЩИНА НОМЕР %d ЗАШЛА В ДУШ\n" RESET, id);
-    fflush(stdout);
+    P(sync, S_SLOTS);
+    if (verbose) {
+        printf(MANG "ЖЕНЩИНА НОМЕР %d ЗАШЛА В ДУШ\n" RESET, id);
+        fflush(stdout);
+    }
 }
 
-static void woman_leave(int sem_id, Shared* sh, int id) {
-    printf(MANG "ЖЕНЩИНА НОМЕР %d ВЫШЛА ИЗ ДУША\n" RESET, id);
-    fflush(stdout);
+static void woman_leave(const Sync& sync, Shared* sh, int id) {
+    if (verbose) {
+        printf(MANG "ЖЕНЩИНА НОМЕР %d ВЫШЛА ИЗ ДУША\n" RESET, id);
+        fflush(stdout);
+    }
 
-    V(sem_id, S_SLOTS);
+    V(sync, S_SLOTS);
 
-    P(sem_id, S_WOM_MTX);
+    P(sync, S_WOM_MTX);
     sh->women_in--;
     if (sh->women_in == 0) {
-        V(sem_id, S_ROOM);
+        V(sync, S_ROOM);
     }
-    V(sem_id, S_WOM_MTX);
+    V(sync, S_WOM_MTX);
 }
 
-static void man_process(int sem_id, Shared* sh, int id) {
-    printf(BLUE "МУЖЧИНА %d СТОИТ ПЕРЕД ДУШЕМ\n" RESET, id);
-    fflush(stdout);
+static const char* const ENTER_MSG[2] = {
+    BLUE "МУЖЧИНА НОМЕР %d ЗАШЕЛ В ДУШ\n" RESET,
+    MANG "ЖЕНЩИНА НОМЕР %d ЗАШЛА В ДУШ\n" RESET,
+};
+static const char* const LEAVE_MSG[2] = {
+    BLUE "МУЖЧИНА НОМЕР %d ВЫШЕЛ ИЗ ДУША\n" RESET,
+    MANG "ЖЕНЩИНА НОМЕР %d ВЫШЛА ИЗ ДУША\n" RESET,
+};
+
+// Вызывается под S_BATCH_MTX после каждого изменения Batch: решает, чей
+// ход, и выдаёт пропуска, пока есть места. Размер партии по умолчанию —
+// все ждущие этого пола на момент смены хода, но не меньше N, так что
+// пришедший позже ждёт не дольше текущей и следующей партий. Если другой
+// пол не ждёт, лимит не действует и места не простаивают.
+static void batch_dispatch(const Sync& sync, Batch* b) {
+    if (b->cur >= 0 && b->inside[b->cur] == 0) {
+        int g = b->cur;
+        if (b->waiting[g] == 0 || (b->admitted >= b->limit && b->waiting[1 - g] > 0)) {
+            b->cur = -1;
+        }
+    }
+    if (b->cur < 0) {
+        if (b->waiting[MAN] == 0 && b->waiting[WOMAN] == 0) return;
+        int g = b->waiting[1 - b->last] > 0 ? 1 - b->last : b->last;
+        b->cur = b->last = g;
+        b->admitted = 0;
+        b->limit = b->batch > 0 ? b->batch : std::max(b->slots, b->waiting[g]);
+    }
+
+    int g = b->cur;
+    while (b->waiting[g] > 0 && b->inside[g] < b->slots &&
+           (b->admitted < b->limit || b->waiting[1 - g] == 0)) {
+        b->waiting[g]--;
+        b->inside[g]++;
+        b->admitted++;
+        V(sync, g == MAN ? S_MEN_GATE : S_WOM_GATE);
+    }
+}
 
-    V(sem_id, S_ARRIVAL); //TODO rename wait & sygnal
-    P(sem_id, S_START);
+static void batch_enter(const Sync& sync, Shared* sh, int g, int id) {
+    P(sync, S_BATCH_MTX);
+    sh->batch.waiting[g]++;
+    batch_dispatch(sync, &sh->batch);
+    V(sync, S_BATCH_MTX);
 
-    man_enter(sem_id, sh, id);
-    man_leave(sem_id, sh, id);
+    P(sync, g == MAN ? S_MEN_GATE : S_WOM_GATE);
+    if (verbose) {
+        printf(ENTER_MSG[g], id);
+        fflush(stdout);
+    }
+}
+
+static void batch_leave(const Sync& sync, Shared* sh, int g, int id) {
+    if (verbose) {
+        printf(LEAVE_MSG[g], id);
+        fflush(stdout);
+    }
+
+    P(sync, S_BATCH_MTX);
+    sh->batch.inside[g]--;
+    batch_dispatch(sync, &sh->batch);
+    V(sync, S_BATCH_MTX);
+}
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// xorshift64*: у каждого процесса свой поток чисел от seed и номера.
+struct Rng {
+    uint64_t state;
+};
+
+static double rng_u01(Rng* r) {
+    r->state ^= r->state >> 12;
+    r->state ^= r->state << 25;
+    r->state ^= r->state >> 27;
+    return (double)((r->state * 0x2545F4914F6CDD1Dull) >> 11) * 0x1.0p-53;
+}
+
+static uint64_t draw_ns(Rng* r, dist_t dist, double mean_ns) {
+    switch (dist) {
+        case DIST_EXP:     return (uint64_t)(-mean_ns * std::log(1.0 - rng_u01(r)));
+        case DIST_UNIFORM: return (uint64_t)(2.0 * mean_ns * rng_u01(r));
+        case DIST_FIXED:   break;
+    }
+    return (uint64_t)mean_ns;
+}
+
+// Время в душе и паузы между визитами: сон, а не занятый цикл —
+// место занято, процессор нет.
+static void sleep_ns(uint64_t ns) {
+    if (!ns) return;
+    struct timespec ts{ (time_t)(ns / 1000000000ull), (long)(ns % 1000000000ull) };
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {}
+}
+
+// Один визит: ожидание допуска, время в душе, выход.
+static void visit(const Sync& sync, Shared* sh, int g, int id, uint64_t service_ns, VisitRec* rec) {
+    rec->arrive = now_ns();
+    if (policy == POLICY_BATCH) batch_enter(sync, sh, g, id);
+    else if (g == MAN)          man_enter(sync, sh, id);
+    else                        woman_enter(sync, sh, id);
+
+    rec->admit = now_ns();
+    sleep_ns(service_ns);
+    rec->leave = now_ns();
+
+    if (policy == POLICY_BATCH) batch_leave(sync, sh, g, id);
+    else if (g == MAN)          man_leave(sync, sh, id);
+    else                        woman_leave(sync, sh, id);
+}
+
+// Все K визитов одного человека; log — его K записей журнала.
+static void visit_loop(const Sync& sync, Shared* sh, int g, int id, const Workload& wl, VisitRec* log) {
+    Rng rng{ (wl.seed + 1ull) * 0x9E3779B97F4A7C15ull + (uint64_t)id * 2 + (uint64_t)g };
+    for (int k = 0; k < wl.visits; ++k) {
+        if (wl.arrival_rate > 0) {
+            sleep_ns(draw_ns(&rng, DIST_EXP, 1.0e9 / wl.arrival_rate));
+        }
+        uint64_t service_ns = draw_ns(&rng, wl.service_dist, wl.service_us * 1.0e3);
+        visit(sync, sh, g, id, service_ns, &log[k]);
+    }
+}
+
+static void man_process(const Sync& sync, Shared* sh, int id, const Workload& wl, VisitRec* log) {
+    if (verbose) {
+        printf(BLUE "МУЖЧИНА %d СТОИТ ПЕРЕД ДУШЕМ\n" RESET, id);
+        fflush(stdout);
+    }
+
+    V(sync, S_ARRIVAL); //TODO rename wait & sygnal
+    P(sync, S_START);
+
+    visit_loop(sync, sh, MAN, id, wl, log);
+    sh->ops.fetch_add(sem_ops);
     _exit(0);
 }
 
-static void woman_process(int sem_id, Shared* sh, int id) {
-    printf(MANG "ЖЕНЩИНА НОМЕР %d СТОИТ ПЕРЕД ДУШЕМ\n" RESET, id);
-    fflush(stdout);
+static void woman_process(const Sync& sync, Shared* sh, int id, const Workload& wl, VisitRec* log) {
+    if (verbose) {
+        printf(MANG "ЖЕНЩИНА НОМЕР %d СТОИТ ПЕРЕД ДУШЕМ\n" RESET, id);
+        fflush(stdout);
+    }
 
-    V(sem_id, S_ARRIVAL);
-    P(sem_id, S_START);
+    V(sync, S_ARRIVAL);
+    P(sync, S_START);
 
-    woman_enter(sem_id, sh, id);
-    woman_leave(sem_id, sh, id);
+    visit_loop(sync, sh, WOMAN, id, wl, log);
+    sh->ops.fetch_add(sem_ops);
     _exit(0);
 }
 
+static VisitRec* create_visit_log(size_t count, int* shm_id) {
+    *shm_id = shmget(IPC_PRIVATE, std::max<size_t>(count, 1) * sizeof(VisitRec), IPC_CREAT | 0600);
+    if (*shm_id == -1) die("shmget(visit log) failed: %s", strerror(errno));
+    void* p = shmat(*shm_id, nullptr, 0);
+    if (p == (void*)-1) die("shmat(visit log) failed: %s", strerror(errno));
+    return (VisitRec*)p;
+}
+
+static void print_percentiles(const char* what, std::vector<uint64_t>& v) {
+    if (v.empty()) return;
+    std::sort(v.begin(), v.end());
+    auto pct = [&](double q) { return (double)v[(size_t)(q * (double)(v.size() - 1) + 0.5)] / 1.0e3; };
+    printf("  %-9s p50 %10.1f  p90 %10.1f  p99 %10.1f  p99.9 %10.1f  max %10.1f\n",
+           what, pct(0.50), pct(0.90), pct(0.99), pct(0.999), pct(1.0));
+}
+
+constexpr int WAIT_BUCKETS = 32;   // гистограмма ожидания: степени двойки мкс
+
+// Разбор журнала: пропускная способность за время от первого прихода до
+// последнего выхода, загрузка N мест, перцентили задержек (мкс) и
+// гистограмма ожидания допуска. Всё считается здесь, после wait(), —
+// сами визиты только пишут три отметки времени.
+static void report_visit_log(const VisitRec* log, int M, int W, int K, int N) {
+    size_t count = (size_t)(M + W) * K;
+    if (!count) return;
+
+    uint64_t first = UINT64_MAX, last = 0, busy = 0;
+    size_t hist[WAIT_BUCKETS] = {};
+    std::vector<uint64_t> wait[2], inside, sojourn;
+    inside.reserve(count);
+    sojourn.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        const VisitRec& r = log[i];
+        int g = i < (size_t)M * K ? MAN : WOMAN;
+        first = std::min(first, r.arrive);
+        last  = std::max(last, r.leave);
+        busy += r.leave - r.admit;
+        wait[g].push_back(r.admit - r.arrive);
+
+        uint64_t us = (r.admit - r.arrive) / 1000;
+        int bucket = us ? 64 - __builtin_clzll(us) : 0;   // 0: <1 мкс, k: [2^(k-1), 2^k)
+        hist[std::min(bucket, WAIT_BUCKETS - 1)]++;
+        inside.push_back(r.leave - r.admit);
+        sojourn.push_back(r.leave - r.arrive);
+    }
+
+    double span_s = (double)(last - first) / 1.0e9;
+    printf("workload: %zu visits in %.3f s, %.0f visits/sec, utilization of %d slots %.1f%%\n",
+           count, span_s, span_s > 0 ? (double)count / span_s : 0.0, N,
+           span_s > 0 ? 100.0 * (double)busy / 1.0e9 / (N * span_s) : 0.0);
+    printf("latency, us:\n");
+    print_percentiles("wait/men", wait[MAN]);
+    print_percentiles("wait/wom", wait[WOMAN]);
+    print_percentiles("service", inside);
+    print_percentiles("sojourn", sojourn);
+
+    printf("wait for admission, us:\n");
+    for (int b = 0; b < WAIT_BUCKETS; ++b) {
+        if (!hist[b]) continue;
+        double share = 100.0 * (double)hist[b] / (double)count;
+        unsigned long lo = b ? 1ul << (b - 1) : 0;
+        printf("  [%8lu, %8lu) %10zu %6.2f%% ", lo, 1ul << b, hist[b], share);
+        for (int i = 0; i < (int)(share / 2); ++i) putchar('#');
+        putchar('\n');
+    }
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, RED "usage: %s [-s sysv|futex] [-p room|batch] [-b size] [-r K] [-a rate]\n"
+                    "          [-t usec] [-d fixed|exp|uniform] [-S seed] [-q] N M W\n" RESET
+                    "  N  shower slots, M men, W women\n"
+                    "  -s semaphores: SysV set (default) or futex words in shared memory\n"
+                    "  -p admission: first gender holds the room (default) or alternating batches\n"
+                    "  -b with -p batch: batch size (default: queue length at turn, at least N)\n"
+                    "  -r K visits per person\n"
+                    "  -a per-person arrival rate, visits/sec (exponential gaps; default back to back)\n"
+                    "  -t mean time spent in the shower per visit, microseconds\n"
+                    "  -d service time distribution (default fixed)\n"
+                    "  -S random seed\n"
+                    "  -q no per-person output\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1.0e3 + (double)ts.tv_nsec / 1.0e6;
+}
+
 int main(int argc, char** argv) {
-    if (argc != 4) {
+    bool use_futex = false;
+    Workload wl{ 1, 0.0, 0, DIST_FIXED, 1 };
+    int batch = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:p:b:r:a:t:d:S:q")) != -1) {
+        switch (opt) {
+            case 's':
+                if      (!strcmp(optarg, "sysv"))  use_futex = false;
+                else if (!strcmp(optarg, "futex")) use_futex = true;
+                else usage(argv[0]);
+                break;
+            case 'p':
+                if      (!strcmp(optarg, "room"))  policy = POLICY_ROOM;
+                else if (!strcmp(optarg, "batch")) policy = POLICY_BATCH;
+                else usage(argv[0]);
+                break;
+            case 'b': batch = atoi(optarg);      break;
+            case 't': wl.service_us = atoi(optarg);     break;
+            case 'r': wl.visits = atoi(optarg);         break;
+            case 'a': wl.arrival_rate = atof(optarg);   break;
+            case 'S': wl.seed = (unsigned)atoi(optarg); break;
+            case 'd':
+                if      (!strcmp(optarg, "fixed"))   wl.service_dist = DIST_FIXED;
+                else if (!strcmp(optarg, "exp"))     wl.service_dist = DIST_EXP;
+                else if (!strcmp(optarg, "uniform")) wl.service_dist = DIST_UNIFORM;
+                else usage(argv[0]);
+                break;
+            case 'q': verbose = false;       break;
+            default:  usage(argv[0]);
+        }
+    }
+    if (argc - optind != 3) {
         fprintf(stderr, RED "expected 3 numbers in command lile\n" RESET);
-        return EXIT_FAILURE;
+        usage(argv[0]);
     }
 
-    const int N = atoi(argv[1]);
-    const int M = atoi(argv[2]);
-    const int W = atoi(argv[3]);
+    const int N = atoi(argv[optind]);
+    const int M = atoi(argv[optind + 1]);
+    const int W = atoi(argv[optind + 2]);
+    if (N <= 0 || M < 0 || W < 0 || wl.visits <= 0 || batch < 0 || wl.service_us < 0 ||
+        wl.arrival_rate < 0) {
+        usage(argv[0]);
+    }
 
     printf(GREEN "\t-----ДУШЕВАЯ КОМНАТА НА %d МЕСТ-----\n" RESET, N);
     fflush(stdout);
     
-    int sem_id = create_semset(N);
     Shared* sh = nullptr;
     int shared_memory_id = create_shm(&sh);
+    sh->batch.batch = batch;
+    sh->batch.slots = N;
+    int log_id = -1;
+    VisitRec* log = create_visit_log((size_t)(M + W) * wl.visits, &log_id);
+    int sem_id = -1;
+    Sync sync{ -1, nullptr };
+    if (use_futex) {
+        init_futex_sems(sh, N);
+        sync.fsem = sh->sem;
+    } else {
+        sem_id = sync.sem_id = create_semset(N);
+    }
 
     for (int i = 1; i <= M; ++i) {
         pid_t man_pid = Fork();
         if (is_child_process(man_pid)) 
-            man_process(sem_id, sh, i);
+            man_process(sync, sh, i, wl, log + (size_t)(i - 1) * wl.visits);
     }
     for (int i = 1; i <= W; ++i) {
         pid_t wom_pid = Fork();
         if (is_child_process(wom_pid)) 
-            woman_process(sem_id, sh, i);
+            woman_process(sync, sh, i, wl, log + (size_t)(M + i - 1) * wl.visits);
     }
 
-    for (int i = 0; i < M + W; ++i) P(sem_id, S_ARRIVAL);
+    for (int i = 0; i < M + W; ++i) P(sync, S_ARRIVAL);
 
     printf(GREEN "\t-----ДУШЕВАЯ КОМНАТА ОТКРЫВАЕТСЯ-----\n" RESET);
     fflush(stdout);
 
-    for (int i = 0; i < M + W; ++i) V(sem_id, S_START);
+    double t_open = now_ms();
+    for (int i = 0; i < M + W; ++i) V(sync, S_START);
 
     int status;
     while (wait(&status) > 0) {}
+    double elapsed = now_ms() - t_open;
+
+    unsigned long ops = sh->ops.load();
+    printf("semaphore ops: %lu in %.3f ms, %.0f ops/sec (%s, %d processes)\n",
+           ops, elapsed, elapsed > 0 ? (double)ops * 1.0e3 / elapsed : 0.0,
+           use_futex ? "futex" : "sysv", M + W);
+    report_visit_log(log, M, W, wl.visits, N);
+
+    shmdt(log);
+    shmctl(log_id, IPC_RMID, nullptr);
 
     cleanup_ipc(sem_id, shared_memory_id, sh);
 
     printf(GREEN "\t-----ДУШЕВАЯ КОМНАТА ПУСТА-----\n" RESET);
     fflush(stdout);
     return 0;
-}
\ No newline at end of file
+}
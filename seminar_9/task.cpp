@@ -1,9 +1,14 @@
+#include <sys/mman.h>
 #include <sys/sem.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <cstdio>
 #include <cstdlib>
 #include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <thread>
+#include <vector>
 
 #define CHECK(expr, msg) \
     do { \
@@ -13,84 +18,255 @@
         } \
     } while (0)
 
-enum { SEM_A = 0, SEM_B = 1, SEM_TOTAL = 2, SEM_MUTEX = 3 };
-constexpr int N_SEMS = 4;
+// Семафор i < types — свободные места под детали типа i в текущем
+// изделии, последний (TOTAL) — сколько деталей изделия ещё не сделано.
+// Каждый шаг — один атомарный semop() над массивом sembuf, поэтому
+// отдельный мьютекс и опрос GETVAL не нужны.
+constexpr int MAX_TYPES = 16;
+
+// Рецепт изделия: типы деталей, их число на изделие и время работы над
+// одной деталью. По умолчанию — 2 детали от гаечного ключа и 1 винт.
+struct Part {
+    char  name[32];
+    short count;      // деталей на изделие
+    int   work_us;    // время изготовления одной детали
+    int   workers;    // рабочих этого типа
+};
+
+struct Recipe {
+    Part  parts[MAX_TYPES];
+    int   types;
+    short total;      // деталей на изделие, сумма count
+};
+
+// Счётчики рабочего; массив в общей памяти, у каждого свой элемент.
+struct alignas(64) WorkerStats {
+    uint64_t parts;
+    uint64_t idle_ns;     // ожидание места в semop()
+    uint64_t busy_ns;     // изготовление деталей
+};
 
 struct Context {
     int semid;
-    int n;
+    int n;          // сколько изделий собрать
+    bool verbose;
+    const Recipe* recipe;
+    WorkerStats* stats;
 };
 
-int acquire(int id, int idx) {
-    struct sembuf op = {static_cast<unsigned short>(idx), -1, 0};
-    return semop(id, &op, 1);
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
 }
 
-int release(int id, int idx) {
-    struct sembuf op = {static_cast<unsigned short>(idx), 1, 0};
-    return semop(id, &op, 1);
+// Готовая деталь: занять место своего типа и отметить её в TOTAL — одним
+// вызовом. Блокируется, пока в изделии нет места под деталь этого типа.
+int make_part(int id, int type, int total_idx) {
+    struct sembuf ops[2] = {
+        {static_cast<unsigned short>(type),      -1, 0},
+        {static_cast<unsigned short>(total_idx), -1, 0},
+    };
+    return semop(id, ops, 2);
 }
 
-int modify(int id, int idx, short delta) {
-    struct sembuf op = {static_cast<unsigned short>(idx), delta, 0};
-    return semop(id, &op, 1);
+// Сборка: дождаться TOTAL == 0 (все детали готовы) и тем же вызовом
+// открыть места под следующее изделие, если оно будет.
+int assemble(int id, const Recipe& r, bool refill) {
+    struct sembuf ops[MAX_TYPES + 2];
+    int n = 0;
+    ops[n++] = {static_cast<unsigned short>(r.types), 0, 0};
+    if (refill) {
+        for (int t = 0; t < r.types; ++t) {
+            ops[n++] = {static_cast<unsigned short>(t), r.parts[t].count, 0};
+        }
+        ops[n++] = {static_cast<unsigned short>(r.types), r.total, 0};
+    }
+    return semop(id, ops, n);
 }
 
-int getval(int id, int idx) {
-    return semctl(id, idx, GETVAL);
+static void work(int usec) {
+    if (usec <= 0) return;
+    struct timespec ts{ usec / 1000000, (long)(usec % 1000000) * 1000 };
+    while (nanosleep(&ts, &ts) == -1) {}
 }
 
-[[noreturn]] void wrench(Context ctx) {
-    while (true) {
-        if (acquire(ctx.semid, SEM_A) < 0) break;
-        fprintf(stderr, "Wrench\n");
+// Рабочий крутится, пока сборщик не удалит набор семафоров (EIDRM).
+// Сначала деталь делается, потом кладётся в изделие: TOTAL уменьшается
+// только у готовой детали, и сборщик не соберёт изделие раньше, чем
+// закончена работа над ним. Время в semop() — простой: готовая деталь
+// ждёт, пока откроется место её типа.
+void worker(Context ctx, int type, int slot) {
+    const Part& part = ctx.recipe->parts[type];
+    WorkerStats& st  = ctx.stats[slot];
 
-        acquire(ctx.semid, SEM_TOTAL);
+    for (;;) {
+        uint64_t t_work = now_ns();
+        work(part.work_us);
+        uint64_t t_wait = now_ns();
 
-        acquire(ctx.semid, SEM_MUTEX);
-        if (getval(ctx.semid, SEM_TOTAL) == 0) {
-            modify(ctx.semid, SEM_A, 2);
-            modify(ctx.semid, SEM_B, 1);
-            modify(ctx.semid, SEM_TOTAL, 3);
-        }
-        release(ctx.semid, SEM_MUTEX);
+        // Деталь, начатая после последнего изделия, не пригодится.
+        if (make_part(ctx.semid, type, ctx.recipe->types) != 0) break;
+        st.busy_ns += t_wait - t_work;
+        st.idle_ns += now_ns() - t_wait;
+        st.parts++;
+        if (ctx.verbose) fprintf(stderr, "%s\n", part.name);
     }
-    fprintf(stderr, "Wrench done\n");
-    exit(0);
+    if (ctx.verbose) fprintf(stderr, "%s done\n", part.name);
 }
 
-[[noreturn]] void screw(Context ctx) {
-    while (ctx.n-- > 0) {
-        if (acquire(ctx.semid, SEM_B) < 0) break;
-        fprintf(stderr, "Screw\n");
+// "wrench:2,screw:1:50" — имя:деталей на изделие[:мкс на деталь].
+static bool parse_recipe(const char* spec, Recipe* r) {
+    r->types = 0;
+    r->total = 0;
+    char buf[512];
+    snprintf(buf, sizeof(buf), "%s", spec);
 
-        acquire(ctx.semid, SEM_TOTAL);
+    char* save = nullptr;
+    for (char* item = strtok_r(buf, ",", &save); item; item = strtok_r(nullptr, ",", &save)) {
+        if (r->types == MAX_TYPES) return false;
+        Part& p = r->parts[r->types];
+        char* colon = strchr(item, ':');
+        if (!colon || colon == item) return false;
+        *colon = '\0';
+        snprintf(p.name, sizeof(p.name), "%s", item);
+        p.count   = (short)atoi(colon + 1);
+        char* usec = strchr(colon + 1, ':');
+        p.work_us = usec ? atoi(usec + 1) : 0;
+        p.workers = 1;
+        if (p.count <= 0 || p.work_us < 0) return false;
+        r->total = (short)(r->total + p.count);
+        r->types++;
+    }
+    return r->types > 0;
+}
 
-        acquire(ctx.semid, SEM_MUTEX);
-        if (getval(ctx.semid, SEM_TOTAL) == 0) {
-            modify(ctx.semid, SEM_A, 2);
-            modify(ctx.semid, SEM_B, 1);
-            modify(ctx.semid, SEM_TOTAL, 3);
-        }
-        release(ctx.semid, SEM_MUTEX);
+// "1,2" — рабочих каждого типа по порядку; одно число — для всех типов.
+static bool parse_workers(const char* spec, Recipe* r) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    char* save = nullptr;
+    int t = 0;
+    for (char* item = strtok_r(buf, ",", &save); item; item = strtok_r(nullptr, ",", &save)) {
+        if (t == r->types) return false;
+        r->parts[t++].workers = atoi(item);
+    }
+    if (t == 1) {
+        for (int i = 1; i < r->types; ++i) r->parts[i].workers = r->parts[0].workers;
+    } else if (t != r->types) {
+        return false;
     }
-    fprintf(stderr, "Screw done\n");
-    semctl(ctx.semid, N_SEMS, IPC_RMID);
-    exit(0);
+    for (int i = 0; i < r->types; ++i) {
+        if (r->parts[i].workers <= 0) return false;
+    }
+    return true;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "usage: %s [-q] [-r recipe] [-w workers] [-m process|thread] [products]\n"
+            "  -r  part types as name:count[:usec],... (default wrench:2,screw:1)\n"
+            "  -w  workers per part type, in recipe order, or one number for all (default 1,2)\n"
+            "  -m  run workers as processes (default) or threads\n"
+            "  -q  no per-part output\n",
+            prog);
+    exit(EXIT_FAILURE);
 }
 
-int main() {
-    unsigned short init[N_SEMS] = {2, 1, 3, 1};
-    int semid = semget(IPC_PRIVATE, N_SEMS, 0666 | IPC_CREAT);
+int main(int argc, char* argv[]) {
+    Recipe recipe;
+    parse_recipe("wrench:2,screw:1", &recipe);
+    parse_workers("1,2", &recipe);
+    const char* workers_spec = nullptr;
+    bool own_recipe = false;
+    bool threaded = false;
+    Context ctx{-1, 10, true, &recipe, nullptr};
+
+    int opt;
+    while ((opt = getopt(argc, argv, "qr:w:m:")) != -1) {
+        switch (opt) {
+            case 'q': ctx.verbose = false; break;
+            case 'r':
+                if (!parse_recipe(optarg, &recipe)) usage(argv[0]);
+                own_recipe = true;
+                break;
+            case 'w': workers_spec = optarg; break;
+            case 'm':
+                if      (strcmp(optarg, "process") == 0) threaded = false;
+                else if (strcmp(optarg, "thread") == 0)  threaded = true;
+                else usage(argv[0]);
+                break;
+            default: usage(argv[0]);
+        }
+    }
+    // Без -w у своего рецепта — по одному рабочему на тип.
+    if (!workers_spec && own_recipe) workers_spec = "1";
+    if (workers_spec && !parse_workers(workers_spec, &recipe)) usage(argv[0]);
+    if (optind < argc) ctx.n = atoi(argv[optind]);
+    if (ctx.n <= 0) usage(argv[0]);
+
+    const int n_sems = recipe.types + 1;
+    std::vector<unsigned short> init(n_sems);
+    for (int t = 0; t < recipe.types; ++t) init[t] = recipe.parts[t].count;
+    init[recipe.types] = recipe.total;
+
+    int semid = semget(IPC_PRIVATE, n_sems, 0666 | IPC_CREAT);
     CHECK(semid, "semget");
-    CHECK(semctl(semid, N_SEMS, SETALL, init), "semctl");
+    CHECK(semctl(semid, 0, SETALL, init.data()), "semctl");
+    ctx.semid = semid;
 
-    Context ctx{semid, 10};
+    int n_workers = 0;
+    for (int t = 0; t < recipe.types; ++t) n_workers += recipe.parts[t].workers;
+    size_t stats_bytes = sizeof(WorkerStats) * n_workers;
+    void* stats = mmap(nullptr, stats_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (stats == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    ctx.stats = static_cast<WorkerStats*>(stats);
+
+    uint64_t t_start = now_ns();
+
+    std::vector<std::thread> crew;
+    for (int t = 0, slot = 0; t < recipe.types; ++t) {
+        for (int w = 0; w < recipe.parts[t].workers; ++w, ++slot) {
+            if (threaded) {
+                crew.emplace_back(worker, ctx, t, slot);
+            } else if (fork() == 0) {
+                worker(ctx, t, slot);
+                exit(0);
+            }
+        }
+    }
 
-    if (fork() == 0) screw(ctx);
-    if (fork() == 0) screw(ctx);
-    if (fork() == 0) wrench(ctx);
+    // Сборщик — родитель (главный поток): одно изделие — один semop.
+    for (int product = 0; product < ctx.n; ++product) {
+        CHECK(assemble(semid, recipe, product + 1 < ctx.n), "semop(assemble)");
+    }
+    uint64_t elapsed = now_ns() - t_start;
 
+    CHECK(semctl(semid, 0, IPC_RMID), "semctl(IPC_RMID)");
+    for (std::thread& th : crew) th.join();
     while (wait(nullptr) > 0);
+
+    double elapsed_ms = (double)elapsed / 1.0e6;
+    printf("assembled %d products in %.3f ms, %.0f products/sec (%d workers, %s)\n",
+           ctx.n, elapsed_ms, elapsed_ms > 0 ? ctx.n * 1.0e3 / elapsed_ms : 0.0,
+           n_workers, threaded ? "threads" : "processes");
+
+    // Простой рабочего — доля времени в ожидании места. У узкого места
+    // рабочие почти не простаивают, остальные ждут его.
+    printf("%-16s %6s %10s %10s %10s %7s\n", "worker", "", "parts", "busy ms", "idle ms", "idle");
+    for (int t = 0, slot = 0; t < recipe.types; ++t) {
+        for (int w = 0; w < recipe.parts[t].workers; ++w, ++slot) {
+            const WorkerStats& st = ctx.stats[slot];
+            printf("%-16s #%-5d %10llu %10.3f %10.3f %6.1f%%\n",
+                   recipe.parts[t].name, w + 1, (unsigned long long)st.parts,
+                   (double)st.busy_ns / 1.0e6, (double)st.idle_ns / 1.0e6,
+                   elapsed ? 100.0 * (double)st.idle_ns / (double)elapsed : 0.0);
+        }
+    }
+
+    munmap(stats, stats_bytes);
     return 0;
-}
\ No newline at end of file
+}